@@ -0,0 +1,118 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QString>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include <cstdint>
+
+struct io_uring;
+
+namespace timelapse {
+
+  constexpr int DEFAULT_WRITER_THREADS = 4;
+
+  /**
+   * Writes whole files asynchronously. Requests are submitted to io_uring
+   * when the library is built with liburing and kernel supports it,
+   * otherwise files are written on thread pool.
+   *
+   * Writer has to be used from the thread where it lives, completion
+   * of every request is signalled in this thread by written signal.
+   * The signal is always delivered from the event loop (or from waitForWritten),
+   * never from inside of write.
+   */
+  class TIME_LAPSE_API AsyncFileWriter : public QObject {
+    Q_OBJECT
+  public:
+    explicit AsyncFileWriter(int threads = DEFAULT_WRITER_THREADS, QObject *parent = nullptr);
+    virtual ~AsyncFileWriter();
+
+    /**
+     * Queue write of data to the file (existing file is truncated).
+     * Returns request id that is reported by written signal.
+     */
+    uint64_t write(const QString &path, const QByteArray &data);
+
+    int pending() const;
+
+    /**
+     * Block until some pending write is completed and deliver written signals
+     * of completed writes. It returns immediately when no write is pending.
+     */
+    void waitForWritten();
+
+  signals:
+    /* error is empty when write succeeded */
+    void written(uint64_t id, QString path, QString error);
+
+  private slots:
+    void onRingNotification();
+
+  private:
+    struct Request {
+      QString path;
+      QByteArray data;
+      int fd{-1};
+      int64_t offset{0};
+    };
+
+    bool initRing();
+    bool submit(uint64_t id);
+    void reapCompletions(bool wait);
+    void complete(uint64_t id, const QString &error);
+    /* record completion, it may be called from any thread */
+    void finish(uint64_t id, const QString &path, const QString &error);
+    /* emit written signals of completed requests */
+    void deliver();
+
+  private:
+    QThreadPool *pool;
+    uint64_t nextId{0};
+    int pendingCount{0};
+
+    bool ringInitialized{false};
+    io_uring *ring{nullptr};
+    int eventFd{-1};
+    QSocketNotifier *notifier{nullptr};
+    QHash<uint64_t, Request> requests;
+
+    struct Completion {
+      uint64_t id;
+      QString path;
+      QString error;
+    };
+
+    QMutex completedMutex;
+    QWaitCondition completedCondition;
+    QList<Completion> completed;
+  };
+
+}
@@ -0,0 +1,55 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace timelapse {
+
+  /**
+   * Linear blend of two 8-bit buffers: out = (a * weightA + b * (256 - weightA) + 128) / 256,
+   * where weightA is in range 0..256. Vectorised implementation (AVX2, SSE2 or NEON)
+   * is selected at runtime, scalar code is used for the tail and on other platforms.
+   */
+  TIME_LAPSE_API void crossfade(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t count, uint32_t weightA);
+
+  /**
+   * Name of crossfade implementation used on this CPU.
+   */
+  TIME_LAPSE_API const char *crossfadeImplementation();
+
+  /**
+   * Names of all crossfade implementations supported by this CPU,
+   * the preferred one first and "scalar" last.
+   */
+  TIME_LAPSE_API std::vector<const char*> crossfadeImplementations();
+
+  /**
+   * Crossfade using given implementation, intended for testing.
+   * Returns false when the implementation is not supported by this CPU.
+   */
+  TIME_LAPSE_API bool crossfade(const char *implementation,
+                                const uint8_t *a, const uint8_t *b, uint8_t *out, size_t count, uint32_t weightA);
+
+}
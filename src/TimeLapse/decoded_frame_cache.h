@@ -0,0 +1,82 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/input_image_info.h>
+#include <TimeLapse/frame.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QMutex>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+
+#include <cstdint>
+
+namespace timelapse {
+
+  constexpr int64_t DEFAULT_FRAME_CACHE_SIZE = int64_t(4) * 1024 * 1024 * 1024;
+
+  /**
+   * Persistent cache of decoded frames, it is shared between runs.
+   *
+   * Entries are keyed by the image path, file size, modification time and
+   * decode parameters (size hint, preview decode). Frames are stored
+   * uncompressed, one file per frame. Files are written to temporary file
+   * and renamed, so the cache directory may be used by more processes
+   * concurrently. Least recently used entries are removed when the cache
+   * grows over its size limit.
+   *
+   * Methods are thread safe.
+   */
+  class TIME_LAPSE_API DecodedFrameCache {
+  public:
+    DecodedFrameCache(const QDir &dir, int64_t maxBytes = DEFAULT_FRAME_CACHE_SIZE);
+
+    DecodedFrameCache(const DecodedFrameCache &) = delete;
+    DecodedFrameCache &operator=(const DecodedFrameCache &) = delete;
+
+    /**
+     * Load cached frame, returns false when there is no valid entry.
+     */
+    bool load(const InputImageInfo &info, const QSize &sizeHint, bool preview, Frame &frame, size_t &depth);
+
+    /**
+     * Store decoded frame. Failures are ignored, cache is just optimization.
+     */
+    void store(const InputImageInfo &info, const QSize &sizeHint, bool preview, const Frame &frame, size_t depth);
+
+    QDir directory() const;
+    int64_t maxBytes() const;
+
+  private:
+    QString entryPath(const InputImageInfo &info, const QSize &sizeHint, bool preview) const;
+
+    /* remove least recently used entries, it expects locked mutex */
+    void evict();
+
+  private:
+    QDir dir;
+    int64_t limit;
+    QMutex mutex;
+    int64_t usedBytes{0};
+  };
+
+}
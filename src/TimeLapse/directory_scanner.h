@@ -0,0 +1,119 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFileInfo>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
+#include <QtCore/QThreadPool>
+
+#include <memory>
+#include <vector>
+
+namespace timelapse {
+
+  constexpr int DEFAULT_SCANNER_THREADS = 8;
+
+  /**
+   * Enumerate input files of directories.
+   *
+   * Directories are listed on thread pool (subdirectories in parallel when
+   * recursive), on Linux by getdents64 syscall, so file types are known
+   * without stat of every entry. Suffix filter is applied to raw entry names.
+   * Hidden entries are skipped.
+   *
+   * Files are returned by next method in the same order as by sequential
+   * listing sorted by name, while the scan is still running. Progress signal
+   * is emitted when listing of some directory is finished.
+   */
+  class TIME_LAPSE_API DirectoryScanner : public QObject {
+    Q_OBJECT
+  public:
+    enum Status {
+      Available,
+      Pending,
+      Finished
+    };
+
+    DirectoryScanner(const QStringList &fileSuffixes, bool recursive, int threads = DEFAULT_SCANNER_THREADS);
+    virtual ~DirectoryScanner();
+
+    /**
+     * Inputs are returned in order as they are added. It has to be called before start.
+     */
+    void addFile(const QString &path);
+    void addDirectory(const QString &path);
+
+    void start();
+
+    /**
+     * Take next file when it is available.
+     * Pending status means that the scan of next directory is not finished yet.
+     */
+    Status next(QFileInfo &file);
+
+  signals:
+    void progress();
+    void error(QString msg);
+    void directoryListed(QString path, int entries);
+
+  private:
+    struct Node;
+
+    struct Entry {
+      QString path;
+      Node *directory{nullptr};
+    };
+
+    struct Node {
+      QString path;
+      QList<Entry> entries;
+      bool done{false};
+    };
+
+    Node *createNode(const QString &path);
+    void submit(Node *node);
+    void scan(Node *node);
+
+    bool acceptFile(const char *name) const;
+
+    /**
+     * List entries of the directory, sorted by name.
+     */
+    bool list(const QString &path, QStringList &files, QStringList &directories, QString &errorMessage) const;
+
+  private:
+    QList<QByteArray> suffixes;
+    bool recursive;
+    QThreadPool *pool;
+
+    QMutex mutex;
+    std::vector<std::unique_ptr<Node>> nodes;
+    Node *root;
+    QList<QPair<Node*, int>> cursor;
+  };
+
+}
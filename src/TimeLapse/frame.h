@@ -0,0 +1,137 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+
+#include <Magick++.h>
+
+#include <QtCore/QSharedData>
+#include <QtCore/QSharedDataPointer>
+#include <QtCore/QMetaType>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace timelapse {
+
+  class FrameData;
+
+  /**
+   * Compact 8-bit image buffer that is passed between pipeline handlers.
+   *
+   * Pixel data are reference counted and shared by frame copies,
+   * first write access to shared data (data(), line()) makes a private copy.
+   * Samples are stored interleaved (RGBRGB...) or planar (RR..GG..BB..),
+   * planar frame stores channel planes one after another.
+   *
+   * Magick::Image (16-bit in common Q16 builds) is used just on codec boundaries,
+   * see fromImage and toImage.
+   */
+  class TIME_LAPSE_API Frame {
+  public:
+    enum Layout {
+      Interleaved,
+      Planar
+    };
+
+    typedef std::function<void(uint8_t*)> Deleter;
+
+    /**
+     * Null frame.
+     */
+    Frame();
+
+    /**
+     * Allocate new frame, pixel data are not initialized.
+     */
+    Frame(int width, int height, int channels = 3, Layout layout = Interleaved);
+
+    Frame(const Frame &other);
+    Frame &operator=(const Frame &other);
+    ~Frame();
+
+    /**
+     * Wrap external memory, deleter is called when the last frame referencing
+     * the data is destroyed. Stride is count of bytes between two lines
+     * (of one plane for planar layout).
+     */
+    static Frame wrap(uint8_t *data, int width, int height, int stride, int channels, Layout layout,
+                      Deleter deleter);
+
+    /**
+     * Convert image to 8-bit interleaved RGB frame.
+     */
+    static Frame fromImage(const Magick::Image &image);
+
+    Magick::Image toImage() const;
+
+    /**
+     * Copy of frame with different layout. Shallow copy when the layout is the same.
+     */
+    Frame converted(Layout layout) const;
+
+    bool isNull() const;
+    int width() const;
+    int height() const;
+    int channels() const;
+    Layout layout() const;
+    int stride() const;
+
+    /**
+     * Count of bytes used by pixel data.
+     */
+    int64_t byteSize() const;
+
+    const uint8_t *constData() const;
+    const uint8_t *constLine(int y, int plane = 0) const;
+
+    uint8_t *data();
+    uint8_t *line(int y, int plane = 0);
+
+  private:
+    QSharedDataPointer<FrameData> d;
+  };
+
+  constexpr int DEFAULT_FRAME_POOL_CAPACITY = 4;
+
+  /**
+   * Recycles pixel buffers of frames with the same geometry. Buffer of acquired frame
+   * returns to the pool when the last frame referencing it is destroyed (in any thread),
+   * so producer of many equally sized frames doesn't allocate new buffer for each of them.
+   */
+  class TIME_LAPSE_API FramePool {
+  public:
+    explicit FramePool(int capacity = DEFAULT_FRAME_POOL_CAPACITY);
+
+    /**
+     * Frame with recycled (or new) buffer, pixel data are not initialized.
+     */
+    Frame acquire(int width, int height, int channels = 3, Frame::Layout layout = Frame::Interleaved);
+
+  private:
+    class State;
+    std::shared_ptr<State> state;
+  };
+
+}
+
+Q_DECLARE_METATYPE(timelapse::Frame)
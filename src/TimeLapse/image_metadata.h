@@ -0,0 +1,63 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+
+#include <QtCore/QDateTime>
+#include <QtCore/QString>
+
+namespace timelapse {
+
+  /**
+   * Image metadata that may be read without decoding pixels.
+   */
+  struct TIME_LAPSE_API ImageMetadata {
+    int width{-1};
+    int height{-1};
+    /* EXIF DateTime in its original form (2015:09:15 07:00:28), empty when it is missing */
+    QString exifDateTime;
+
+    QDateTime timestamp() const;
+  };
+
+  /**
+   * Reader of image dimensions and EXIF timestamp.
+   *
+   * JPEG and TIFF based files (TIFF, DNG and most of camera RAW formats)
+   * are parsed natively, just markers and IFD entries are read.
+   * Other formats are pinged by ImageMagick. Methods may be called from any thread.
+   */
+  class TIME_LAPSE_API ImageMetadataParser {
+  public:
+    /**
+     * Parse JPEG or TIFF headers.
+     * @return false when format is not supported or headers are broken
+     */
+    static bool parseHeaders(const QString &path, ImageMetadata &metadata);
+
+    /**
+     * Parse headers, ImageMagick ping is used for other formats.
+     * @return false on error, error message is stored to error argument
+     */
+    static bool read(const QString &path, ImageMetadata &metadata, QString &error);
+  };
+
+}
@@ -45,7 +45,12 @@ public:
   int width{-1};
   int height{-1};
   int frame{-1};
+  /* count of consecutive output frames (starting with frame) represented by this one,
+   * stages process repeated frame once, final sinks expand it */
+  int repeat{1};
   QDateTime timestamp;
   double luminance{-1};
   double luminanceChange{0};
+  /* flow control credit held by this frame, -1 if frame don't hold any */
+  int64_t credit{-1};
 };
@@ -23,12 +23,23 @@
 
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/pipeline_worker_pool.h>
+#include <TimeLapse/pipeline_flow_control.h>
+#include <TimeLapse/pipeline_stats.h>
+#include <TimeLapse/pipeline_trace.h>
 #include <TimeLapse/pipeline_source.h>
 #include <TimeLapse/pipeline_cpt.h>
+#include <TimeLapse/pipeline_pixel_map.h>
 
 #include <QtCore/QObject>
 #include <QtCore/QDebug>
 #include <QtCore/QSharedPointer>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QMap>
+#include <QtCore/QSet>
 
 #include <Magick++.h>
 
@@ -37,6 +48,31 @@ using namespace timelapse;
 
 namespace timelapse {
 
+  constexpr int DEFAULT_STAGE_QUEUE_CAPACITY = 2;
+
+  class Pipeline;
+
+  /**
+   * Branch of the pipeline created by Pipeline::fork. Handlers appended to the branch
+   * are connected after the handler that was the end of the pipeline (or branch) when
+   * the branch was created. Branch is owned by the pipeline.
+   */
+  class TIME_LAPSE_API PipelineBranch {
+  public:
+    void operator<<(ImageHandler *handler);
+    void operator<<(InputHandler *handler);
+
+    PipelineBranch* fork();
+
+  private:
+    friend class Pipeline;
+    PipelineBranch(Pipeline *pipeline, InputHandler *lastInputHandler, ImageHandler *lastImageHandler);
+
+    Pipeline *pipeline;
+    InputHandler *lastInputHandler;
+    ImageHandler *lastImageHandler;
+  };
+
   class TIME_LAPSE_API Pipeline : public QObject {
     Q_OBJECT
 
@@ -52,14 +88,110 @@ namespace timelapse {
     void operator<<(ImageHandler *handler);
     void operator<<(InputHandler *handler);
 
+    /**
+     * Create new branch starting at the current end of the pipeline.
+     * The handler then feeds every branch (and following handlers of the pipeline),
+     * frames are shared by branches, first write access makes a private copy.
+     * Every branch finishes independently, done is emitted when all of them finish.
+     *
+     * With flow control, credit of the frame is released by the first branch
+     * that releases it, so the memory budget is approximate for forked pipelines.
+     */
+    PipelineBranch* fork();
+
+    /**
+     * Run every pipeline stage (except the source) in its own thread.
+     * Stages are connected by queued connections and every stage may have
+     * at most queueCapacity frames waiting in its queue, upstream stage
+     * is blocked when the queue is full.
+     *
+     * It has to be called before first handler is appended.
+     */
+    void setThreaded(int queueCapacity = DEFAULT_STAGE_QUEUE_CAPACITY);
+    bool isThreaded() const;
+
+    /**
+     * Output streams that should be used by new pipeline stage.
+     * In threaded mode every call returns new stream owned by the pipeline,
+     * its output is forwarded to the main thread.
+     */
+    QTextStream* stageVerboseOutput();
+    QTextStream* stageErr();
+
+    /**
+     * Limit number of decoded frames in flight (and their memory when maxBytes > 0).
+     * Source stops emitting new inputs until downstream stages release some credit.
+     *
+     * It requires threaded mode and it has to be called before first handler is appended.
+     */
+    void setFlowControl(int maxFrames = DEFAULT_MAX_IN_FLIGHT_FRAMES, int64_t maxBytes = 0);
+
+    /**
+     * Number of workers used for image loading and for stateless handlers
+     * created by parallel method. Default is one (no worker pool).
+     */
+    void setWorkers(int workers);
+    int workers() const;
+
+    /**
+     * Count of images decoded ahead by image loader on background threads.
+     * It is used just with single loader (one worker), worker pool decodes
+     * images in parallel already. It has to be called before first handler is appended.
+     */
+    void setReadAhead(int count);
+
+    /**
+     * Decode images at 1/8 scale for loaders that are followed just by analysis
+     * stages (scale invariant stages without any output frame size, like ComputeLuminance).
+     */
+    void setFastAnalysis(bool fast);
+
+    /**
+     * Persistent cache of decoded frames used by image loaders.
+     * It has to be called before first handler is appended.
+     */
+    void setFrameCache(QSharedPointer<DecodedFrameCache> cache);
+
+    /**
+     * Metadata index used by the source, luminance and metadata stages.
+     * Modified index is written when the pipeline is done.
+     * It has to be called before first handler is appended.
+     */
+    void setSequenceIndex(QSharedPointer<SequenceIndex> index);
+
+    /**
+     * Create stateless image handler. When more workers are configured,
+     * handlers are wrapped to ImageHandlerPool, results are still emitted
+     * in input order.
+     */
+    ImageHandler* parallel(ImageHandlerFactory factory);
+
+    /**
+     * Per-stage performance report (frames in/out, busy time, queue wait,
+     * processed bytes and latency percentiles), every appended handler is instrumented.
+     */
+    QJsonDocument stats() const;
+    bool writeStats(const QString &file) const;
+
+    /**
+     * Record span of every frame in every stage (and end of stream processing)
+     * in Chrome trace-event format. It has to be called before process.
+     */
+    void enableTrace();
+    bool writeTrace(const QString &file) const;
+
     static Pipeline* createWithCaptureSource(QSharedPointer<CaptureDevice> dev, int64_t interval, int32_t cnt,
             QTextStream *verboseOutput, QTextStream *err);
     static Pipeline* createWithFileSource(const QStringList &inputArguments, const QStringList &fileSuffixes, bool recursive,
             QTextStream *verboseOutput, QTextStream *err);
+    static Pipeline* createWithWatchSource(const QString &directory, const QStringList &fileSuffixes,
+            int64_t quiescenceMs, const QString &sentinel,
+            QTextStream *verboseOutput, QTextStream *err);
 
 
   public slots:
     void process();
+    void sinkFinished();
     void handlerFinished();
     void onError(QString msg);
 
@@ -69,7 +201,40 @@ namespace timelapse {
     void imageLoaded(int stage, int cnt);
 
   private:
+    friend class PipelineBranch;
+
     void append(PipelineHandler* handler);
+    void chain(InputHandler *&lastInputHandler, ImageHandler *&lastImageHandler, ImageHandler *handler);
+    void chain(InputHandler *&lastInputHandler, ImageHandler *&lastImageHandler, InputHandler *handler);
+
+    /**
+     * Fuse pixel map handler (or pool of them) to previous one, so both maps
+     * are applied in one pass. Fused handler is not chained then.
+     * @return false when handlers can't be fused
+     */
+    bool fuse(ImageHandler *previous, ImageHandler *handler);
+    QTextStream* stageStream(QTextStream *target);
+
+    StageStats* stageStats(PipelineHandler *handler);
+    void connectLast(PipelineHandler *from, PipelineHandler *to);
+
+    /**
+     * Compute the smallest frame size that stages after the handler need.
+     * @return false when some stage needs frames in original resolution
+     */
+    bool requiredSize(PipelineHandler *handler, QSize &size) const;
+
+    /**
+     * Some stage after the handler needs pixels of the image, it may be called from any thread.
+     */
+    bool pixelsRequired(PipelineHandler *handler, const InputImageInfo &info) const;
+    CreditTracker* creditTracker(PipelineHandler *handler);
+    void admit(CreditTracker *tracker, InputImageInfo &info);
+
+    template<typename Receiver>
+    void connectInput(InputHandler *from, Receiver *to, void (Receiver::*slot)(InputImageInfo));
+    template<typename Receiver>
+    void connectImage(ImageHandler *from, Receiver *to, void (Receiver::*slot)(InputImageInfo, Frame));
 
   private:
     QTextStream *verboseOutput;
@@ -79,5 +244,34 @@ namespace timelapse {
     int stage=0;
     InputHandler *lastInputHandler;
     ImageHandler *lastImageHandler;
+
+    bool threaded=false;
+    int queueCapacity=DEFAULT_STAGE_QUEUE_CAPACITY;
+    int workerCount=1;
+    int readAhead=0;
+    bool fastAnalysis=false;
+    QSharedPointer<DecodedFrameCache> frameCache;
+    /* long running watch jobs don't fail on single broken file */
+    bool skipUndecodable=false;
+    QSharedPointer<SequenceIndex> sequenceIndex;
+    FlowControl *flowControl=nullptr;
+    QList<CreditTracker*> creditTrackers;
+    QList<QThread*> threads;
+    QList<QSemaphore*> queues;
+    QList<QTextStream*> stageStreams;
+    QList<StageStats*> stageStatsList;
+    QMap<PipelineHandler*, StageStats*> stageStatsMap;
+    QElapsedTimer wallTimer;
+    TraceRecorder *trace=nullptr;
+    /* images loaded by stage, counted in the pipeline thread */
+    QMap<int, int64_t> loadedImages;
+
+    QList<PipelineBranch*> branches;
+    QMap<PipelineHandler*, QList<PipelineHandler*>> downstream;
+    QSet<PipelineHandler*> forkPoints;
+    QList<PipelineHandler*> fusedHandlers;
+    QList<ImageHandler*> loaders;
+    QList<PipelineHandler*> sinks;
+    int finishedSinks=0;
   };
 }
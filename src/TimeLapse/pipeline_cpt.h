@@ -208,7 +208,7 @@ namespace timelapse {
 
   public slots:
     virtual void capture();
-    void onInputImg(InputImageInfo info, Magick::Image img) override;
+    void onInputImg(InputImageInfo info, Frame frame) override;
     void imageCaptured(QString format, Magick::Blob blob, Magick::Geometry sizeHint);
 
   private:
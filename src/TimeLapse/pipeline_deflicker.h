@@ -22,28 +22,52 @@
 #include <TimeLapse/timelapse.h>
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/pipeline_pixel_map.h>
+#include <TimeLapse/sequence_index.h>
 
 #include <QtCore/QObject>
 #include <QtCore/QDebug>
 #include <QtCore/QTemporaryDir>
 
-#include <Magick++.h>
+#include <array>
+#include <cstdint>
+#include <list>
 
 namespace timelapse {
 
   class TIME_LAPSE_API ComputeLuminance : public ImageHandler {
     Q_OBJECT
   public:
+    /**
+     * Per-channel (R, G, B) histograms of 8-bit samples.
+     */
+    typedef std::array<std::array<uint64_t, 256>, 3> Histograms;
+
     explicit ComputeLuminance(QTextStream *verboseOutput);
 
-    static double computeLuminance(
-            const std::vector<std::pair<Magick::Color, size_t>> &histogram,
-            double gamma = 1.0);
+    static Histograms histograms(const Frame &frame);
+
+    /**
+     * Perceived luminance (0..255) of frame with given histograms after gamma correction.
+     */
+    static double computeLuminance(const Histograms &histograms, double gamma = 1.0);
+
+    /**
+     * Luminance of indexed files is not computed again, new values are recorded.
+     */
+    void setSequenceIndex(SequenceIndex *index);
+
+    virtual bool scaleInvariant() const override {
+      return true;
+    }
+
+    virtual bool pixelsRequired(const InputImageInfo &info) const override;
 
   public slots:
-    virtual void onInputImg(InputImageInfo info, Magick::Image img) override;
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
   private:
     QTextStream *verboseOutput;
+    SequenceIndex *sequenceIndex=nullptr;
   };
 
   /**
@@ -62,7 +86,8 @@ namespace timelapse {
   };
 
   /**
-   * Compute target luminance by weighted moving average
+   * Compute target luminance by weighted moving average of previous images,
+   * images are emitted without waiting for the last one.
    */
   class TIME_LAPSE_API WMALuminance : public InputHandler {
     Q_OBJECT
@@ -74,15 +99,19 @@ namespace timelapse {
   private:
     size_t count;
     QTextStream *verboseOutput;
-    QList<InputImageInfo> inputs;
+    std::list<double> queue;
   };
 
-  class TIME_LAPSE_API AdjustLuminance : public ImageHandler {
+  class TIME_LAPSE_API AdjustLuminance : public PixelMapHandler {
     Q_OBJECT
   public:
     AdjustLuminance(QTextStream *verboseOutput, bool debugView);
-  public slots:
-    virtual void onInputImg(InputImageInfo info, Magick::Image img) override;
+
+    virtual bool scaleInvariant() const override {
+      return true;
+    }
+
+    virtual bool pixelMap(const InputImageInfo &info, const Frame &frame, PixelMap &map) override;
   private:
     QTextStream *verboseOutput;
     bool debugView;
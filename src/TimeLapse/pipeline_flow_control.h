@@ -0,0 +1,126 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QWaitCondition>
+
+#include <cstdint>
+
+namespace timelapse {
+
+  constexpr int DEFAULT_MAX_IN_FLIGHT_FRAMES = 16;
+  /* stages like FramePrepare keep one frame, we have to allow at least two to make progress */
+  constexpr int MIN_IN_FLIGHT_FRAMES = 2;
+
+  /**
+   * Credit based flow control for threaded pipeline.
+   *
+   * Every decoded frame in the pipeline holds one credit, new credit is not
+   * granted when there are maxFrames frames in flight or when expected memory
+   * of decoded frames would exceed maxBytes. Expected size of the new frame
+   * is computed as average size of already decoded frames.
+   *
+   * Credits are identified by unique id stored in InputImageInfo::credit,
+   * release is idempotent.
+   */
+  class TIME_LAPSE_API FlowControl : public QObject {
+    Q_OBJECT
+    Q_DISABLE_COPY(FlowControl)
+
+  public:
+    FlowControl(int maxFrames, int64_t maxBytes);
+
+    /**
+     * Acquire credit when it is available.
+     * @return credit id or -1 when there is no credit available
+     */
+    int64_t tryAcquire();
+
+    /**
+     * Acquire credit, block the calling thread until some credit is released.
+     */
+    int64_t acquire();
+
+    /**
+     * Account memory used by frame that holds given credit.
+     */
+    void account(int64_t credit, int64_t bytes);
+
+    void release(int64_t credit);
+
+    /**
+     * Stop limiting, threads blocked in acquire are woken up.
+     * It is used when the pipeline is destroyed.
+     */
+    void close();
+
+    int inFlight();
+    int64_t inFlightBytes();
+
+  signals:
+    void released();
+
+  private:
+    bool available() const;
+    int64_t grant();
+
+  private:
+    int maxFrames;
+    int64_t maxBytes;
+    bool closed{false};
+
+    QMutex mutex;
+    QWaitCondition condition;
+    QMap<int64_t, int64_t> credits; // credit id -> accounted bytes
+    int64_t bytes{0};
+    int64_t nextCredit{0};
+    int64_t accountedFrames{0};
+    int64_t accountedBytes{0};
+  };
+
+  /**
+   * Tracks credits of frames passing through one image handler.
+   * Handlers keep the frame order, so when handler emits frame with some credit,
+   * all frames received before it that were not emitted are dropped
+   * and their credits may be released.
+   *
+   * All methods have to be called from the handler thread.
+   */
+  class TIME_LAPSE_API CreditTracker {
+  public:
+    explicit CreditTracker(FlowControl *flowControl);
+
+    void onInput(int64_t credit);
+    void onOutput(int64_t credit);
+    void onLast();
+
+  private:
+    FlowControl *flowControl;
+    QList<QPair<int64_t, bool>> held; // credit, emitted
+  };
+
+}
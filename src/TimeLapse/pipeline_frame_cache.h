@@ -0,0 +1,90 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/input_image_info.h>
+#include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/pipeline_flow_control.h>
+#include <TimeLapse/frame.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QDir>
+#include <QtCore/QList>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QTemporaryFile>
+
+#include <cstdint>
+
+namespace timelapse {
+
+  constexpr int64_t DEFAULT_FRAME_CACHE_MEMORY = 512 * 1024 * 1024;
+
+  /**
+   * Stage separator that keeps decoded frames, so the next pass don't need
+   * to decode images again. Frames are held in memory up to the memory budget,
+   * others are written uncompressed to scratch file that is memory-mapped
+   * when frames are emitted.
+   *
+   * Credits of cached frames are released on input, the cache has own budget.
+   */
+  class TIME_LAPSE_API FrameCacheSeparator : public ImageHandler {
+    Q_OBJECT
+  public:
+    FrameCacheSeparator(QTextStream *verboseOutput, QTextStream *err,
+                        int64_t memoryBudget = DEFAULT_FRAME_CACHE_MEMORY,
+                        const QString &scratchDir = QDir::tempPath());
+    virtual ~FrameCacheSeparator();
+
+    void setFlowControl(FlowControl *flowControl);
+
+  public slots:
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
+    virtual void onLast() override;
+
+  private:
+    struct Entry {
+      InputImageInfo info;
+      Frame frame; // null when spilled
+      int64_t offset{-1};
+      int width{0};
+      int height{0};
+      int channels{0};
+      Frame::Layout layout{Frame::Interleaved};
+    };
+
+    class ScratchFile;
+
+    bool spill(Entry &entry, const Frame &frame);
+
+  private:
+    QTextStream *verboseOutput;
+    QTextStream *err;
+    int64_t memoryBudget;
+    int64_t memoryUsed{0};
+    QString scratchDir;
+    FlowControl *flowControl{nullptr};
+
+    QList<Entry> entries;
+    QSharedPointer<ScratchFile> scratch;
+    int64_t scratchSize{0};
+  };
+
+}
@@ -36,17 +36,21 @@ namespace timelapse {
 
   public:
     explicit FramePrepare(QTextStream *verboseOutput, int frameCount);
-    virtual void blend(InputImageInfo info1, const Magick::Image *img1, InputImageInfo info2, const Magick::Image *img2);
+    virtual void blend(InputImageInfo info1, const Frame *img1, InputImageInfo info2, const Frame *img2);
+
+    virtual bool scaleInvariant() const override {
+      return true;
+    }
 
   public slots:
-    void onInputImg(InputImageInfo info, Magick::Image img) override;
+    void onInputImg(InputImageInfo info, Frame frame) override;
     void onLast() override;
 
   protected:
     QTextStream * verboseOutput;
 
   private:
-    Magick::Image * prevImage=nullptr;
+    Frame * prevImage=nullptr;
     InputImageInfo prevInfo;
     int frameCount=0;
   };
@@ -55,7 +59,16 @@ namespace timelapse {
     Q_OBJECT
   public:
     BlendFramePrepare(QTextStream *verboseOutput, int frameCount);
-    virtual void blend(InputImageInfo info1, const Magick::Image *img1, InputImageInfo info2, const Magick::Image *img2) override;
+    virtual void blend(InputImageInfo info1, const Frame *img1, InputImageInfo info2, const Frame *img2) override;
+
+    /**
+     * Pixel-wise blend: a * opacity + b * (1 - opacity). Frames have to have equal geometry.
+     * Result buffer is taken from the pool when it is provided.
+     */
+    static Frame blendFrames(const Frame &a, const Frame &b, double opacity, FramePool *pool = nullptr);
+
+  private:
+    FramePool pool;
   };
 
 }
@@ -21,12 +21,26 @@
 
 #include <TimeLapse/timelapse.h>
 #include <TimeLapse/input_image_info.h>
+#include <TimeLapse/pipeline_flow_control.h>
+#include <TimeLapse/frame.h>
+#include <TimeLapse/decoded_frame_cache.h>
+#include <TimeLapse/sequence_index.h>
+#include <TimeLapse/image_metadata.h>
 
 #include <Magick++.h>
 
 #include <QtCore/QObject>
 #include <QtCore/QDebug>
 #include <QtCore/QTemporaryDir>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QSize>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include <functional>
 
 namespace timelapse {
 
@@ -55,10 +69,35 @@ constexpr int FRAME_FILE_LEADING_ZEROS = 9;
   class TIME_LAPSE_API ImageHandler : public PipelineHandler {
     Q_OBJECT
   public:
+    /**
+     * Handler produces equivalent result for downscaled frame (luminance, blending...),
+     * so images may be decoded at reduced size when following stages don't need full resolution.
+     */
+    virtual bool scaleInvariant() const {
+      return false;
+    }
+
+    /**
+     * Size of output frames when the handler scales frames to fixed size, invalid size otherwise.
+     */
+    virtual QSize outputSize() const {
+      return QSize();
+    }
+
+    /**
+     * Handler reads pixels of the frame. Handlers that process some frames just
+     * by metadata (luminance from the index) return false for them, loader
+     * may skip decoding when no following stage needs the pixels.
+     * It may be called from any thread.
+     */
+    virtual bool pixelsRequired([[maybe_unused]] const InputImageInfo &info) const {
+      return true;
+    }
+
   public slots:
-    virtual void onInputImg(InputImageInfo info, Magick::Image img) = 0;
+    virtual void onInputImg(InputImageInfo info, Frame frame) = 0;
   signals:
-    void inputImg(InputImageInfo info, Magick::Image img);
+    void inputImg(InputImageInfo info, Frame frame);
   };
 
   class TIME_LAPSE_API ImageLoader : public ImageHandler {
@@ -67,14 +106,101 @@ constexpr int FRAME_FILE_LEADING_ZEROS = 9;
     void onImageLoaded(int stage, int cnt);
   public:
     ImageLoader(QTextStream *verboseOutput, QTextStream *err, int stage);
+    virtual ~ImageLoader();
+
+    /**
+     * Frames without flow control credit wait for a credit before loading.
+     */
+    void setFlowControl(FlowControl *flowControl);
+
+    /**
+     * Decode up to count following images on background threads while
+     * downstream stages process current frame. Frames (and decode errors)
+     * are still emitted in input order. Zero disables read-ahead.
+     */
+    void setReadAhead(int count);
+
+    /**
+     * Decoder may scale the image down (JPEG DCT scaling) while it is still
+     * at least as big as given size. Invalid size means original resolution.
+     */
+    void setSizeHint(const QSize &size);
+
+    /**
+     * Decode just 1/8 scaled image. JPEG images are decoded from DC coefficients
+     * of DCT blocks (without full decode), other formats are scaled down after decoding.
+     * Frames are usable just for image statistics (luminance).
+     */
+    void setPreviewDecode(bool preview);
+
+    /**
+     * Look up decoded frames in persistent cache before decoding,
+     * decoded frames are stored to the cache.
+     */
+    void setFrameCache(QSharedPointer<DecodedFrameCache> cache);
+
+    /**
+     * Images that can't be decoded are reported and skipped instead of failing the pipeline.
+     */
+    void setSkipUndecodable(bool skip);
+
+    /**
+     * Predicate deciding whether following stages need pixels of the image.
+     * Image is not decoded when it returns false, null frame is emitted instead.
+     */
+    void setPixelsRequired(std::function<bool(const InputImageInfo&)> predicate);
+
+    /**
+     * Result of image decoding, it may be created in any thread.
+     */
+    struct Decoded {
+      bool done{false};
+      bool usable{false};
+      bool cached{false};
+      bool skipped{false};
+      Frame frame;
+      size_t depth{8};
+      int64_t durationMs{0};
+      QString warning;
+      QString error;
+    };
+
+    /**
+     * Decode image to 8-bit frame, it may be called from any thread.
+     * Cache is optional.
+     */
+    static void decode(const InputImageInfo &info, const QSize &sizeHint, bool preview,
+                       DecodedFrameCache *cache, Decoded &result);
+
   public slots:
-    virtual void onInputImg(InputImageInfo info, Magick::Image img) override;
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
     virtual void onInput(InputImageInfo info);
+    virtual void onLast() override;
+  private:
+    void finish(InputImageInfo info, const Decoded &result);
+
+    /* emit decoded images from head of the read-ahead queue */
+    void drainReadAhead();
+    void waitForHead();
+
   private:
     QTextStream *verboseOutput;
     QTextStream *err;
     int stage;
     int cnt=0;
+    FlowControl *flowControl=nullptr;
+
+    int readAhead=0;
+    bool skipUndecodable=false;
+    QSize sizeHint;
+    bool previewDecode=false;
+    QSharedPointer<DecodedFrameCache> frameCache;
+    std::function<bool(const InputImageInfo&)> pixelsRequired;
+    QThreadPool *decoderPool=nullptr;
+    QMutex readAheadMutex;
+    QWaitCondition readAheadCondition;
+    QList<QPair<InputImageInfo, QSharedPointer<Decoded>>> readAheadQueue;
+    bool lastReceived=false;
   };
 
   class TIME_LAPSE_API ImageTrash : public InputHandler {
@@ -82,7 +208,7 @@ constexpr int FRAME_FILE_LEADING_ZEROS = 9;
   public:
   public slots:
     virtual void onInput(InputImageInfo info) override;
-    virtual void onInputImg(InputImageInfo info, Magick::Image img);
+    virtual void onInputImg(InputImageInfo info, Frame frame);
   };
 
   class TIME_LAPSE_API StageSeparator : public InputHandler {
@@ -96,15 +222,47 @@ constexpr int FRAME_FILE_LEADING_ZEROS = 9;
 
   };
 
-  class TIME_LAPSE_API ImageMetadataReader : public ImageHandler {
+  constexpr int DEFAULT_METADATA_THREADS = 4;
+
+  /**
+   * Read image dimensions and EXIF timestamp, image pixels are not decoded.
+   * Headers are parsed on small thread pool, inputs are emitted in original order.
+   */
+  class TIME_LAPSE_API ImageMetadataReader : public InputHandler {
     Q_OBJECT
   public:
-    ImageMetadataReader(QTextStream *verboseOutput, QTextStream *err);
+    ImageMetadataReader(QTextStream *verboseOutput, QTextStream *err, int threads = DEFAULT_METADATA_THREADS);
+    virtual ~ImageMetadataReader();
+
+    /**
+     * Timestamps of indexed files are not read again, new ones are recorded.
+     */
+    void setSequenceIndex(SequenceIndex *index);
   public slots:
-    virtual void onInputImg(InputImageInfo info, Magick::Image img) override;
+    virtual void onInput(InputImageInfo info) override;
+    virtual void onLast() override;
+  private:
+    struct Result {
+      bool done{false};
+      bool ok{false};
+      ImageMetadata metadata;
+      QString error;
+    };
+
+    void finish(InputImageInfo info, const Result &result);
+
+    /* emit inputs from head of the queue with parsed metadata */
+    void drain();
+
   private:
     QTextStream *verboseOutput;
     QTextStream *err;
+    SequenceIndex *sequenceIndex=nullptr;
+
+    QThreadPool *pool;
+    QMutex mutex;
+    QList<QPair<InputImageInfo, QSharedPointer<Result>>> queue;
+    bool lastReceived=false;
   };
 
 }
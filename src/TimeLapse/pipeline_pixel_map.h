@@ -0,0 +1,136 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/input_image_info.h>
+#include <TimeLapse/pipeline_handler.h>
+
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QTextStream>
+
+#include <array>
+#include <cstdint>
+
+namespace timelapse {
+
+  typedef std::array<uint8_t, 256> Lut;
+
+  /**
+   * Per-channel lookup table for 8-bit color samples (alpha is not mapped).
+   * Map may have different tables for columns left of split column
+   * (used by debug views that keep part of the frame original).
+   */
+  class TIME_LAPSE_API PixelMap {
+  public:
+    enum Region {
+      All,
+      /* columns right of the split */
+      Right
+    };
+
+    PixelMap();
+
+    static Lut identityLut();
+
+    /**
+     * Compose lut after current mapping of given color channel (0-2, -1 for all color channels).
+     */
+    void map(const Lut &lut, int channel = -1, Region region = All);
+
+    /**
+     * Split the frame at column x, left part keeps current mapping when following
+     * maps are applied just to Right region. Returns false when the map
+     * is already split at different column.
+     */
+    bool split(int x);
+
+    /**
+     * Lookup table of channel for columns right of the split (whole frame without split).
+     */
+    const Lut &lut(int channel) const;
+
+    bool isIdentity() const;
+
+    /**
+     * Apply the map to frame in one pass.
+     */
+    void apply(Frame &frame) const;
+
+  private:
+    int splitX{0};
+    std::array<Lut, 3> left;
+    std::array<Lut, 3> right;
+  };
+
+  /**
+   * Base for stages that are pure per-pixel maps of color samples. Consecutive
+   * pixel map stages are fused by Pipeline: first stage composes maps of all fused
+   * stages into one PixelMap and frame memory is walked just once.
+   */
+  class TIME_LAPSE_API PixelMapHandler : public ImageHandler {
+    Q_OBJECT
+  public:
+    /**
+     * Compose mapping of this stage into the map. Frame is input of the first fused stage,
+     * the map is not applied on it yet. Returns false when the mapping can't be composed
+     * with current map, map is applied to the frame then and method is called again
+     * with identity map. It may be called from thread of other (fused) stage.
+     */
+    virtual bool pixelMap(const InputImageInfo &info, const Frame &frame, PixelMap &map) = 0;
+
+    /**
+     * Process maps of next stage in this stage. Next stage is not owned.
+     */
+    void fuse(PixelMapHandler *next);
+
+    /**
+     * Class names of this and fused handlers joined by "+", it is used as stage name.
+     */
+    QString fusedName() const;
+
+  public slots:
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
+
+  private:
+    QList<PixelMapHandler*> fused;
+  };
+
+  /**
+   * Multiply color samples by constant gain (exposure correction).
+   */
+  class TIME_LAPSE_API AdjustGain : public PixelMapHandler {
+    Q_OBJECT
+  public:
+    AdjustGain(QTextStream *verboseOutput, double gain);
+
+    virtual bool scaleInvariant() const override {
+      return true;
+    }
+
+    virtual bool pixelMap(const InputImageInfo &info, const Frame &frame, PixelMap &map) override;
+
+  private:
+    QTextStream *verboseOutput;
+    Lut lut;
+  };
+
+}
@@ -22,6 +22,7 @@
 #include <TimeLapse/timelapse.h>
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/resampler.h>
 
 #include <Magick++.h>
 
@@ -29,20 +30,34 @@
 #include <QtCore/QDebug>
 #include <QtCore/QTemporaryDir>
 
+#include <memory>
+
 namespace timelapse {
   
   class TIME_LAPSE_API ResizeFrame : public ImageHandler {
     Q_OBJECT
   public:
+    /**
+     * When width is not positive, it is computed from height and frame aspect ratio.
+     */
     ResizeFrame(QTextStream *verboseOutput, int w, int h, bool adaptiveResize);
+
+    /**
+     * Resize frames by internal resampler instead of ImageMagick.
+     * Threads are used for row passes of one frame.
+     */
+    ResizeFrame(QTextStream *verboseOutput, int w, int h, Resampler::Filter filter, int threads = 1);
+
+    virtual QSize outputSize() const override;
   public slots:
-    virtual void onInputImg(InputImageInfo info, Magick::Image img) override;
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
 
   private:
     QTextStream *verboseOutput;
     int width;
     int height;
     bool adaptiveResize;
+    std::unique_ptr<Resampler> resampler;
   };
 
 }
@@ -22,6 +22,9 @@
 #include <TimeLapse/timelapse.h>
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/pipeline_flow_control.h>
+#include <TimeLapse/sequence_index.h>
+#include <TimeLapse/directory_scanner.h>
 
 #include <Magick++.h>
 
@@ -37,22 +40,48 @@ namespace timelapse {
     virtual ~PipelineSource() {
     };
     virtual void process() = 0;
+
+    /**
+     * Source that supports flow control don't emit new input
+     * until there is some credit available.
+     */
+    virtual void setFlowControl([[maybe_unused]] FlowControl *flowControl) {
+    };
+
+    /**
+     * Source of files fills metadata known by the index.
+     */
+    virtual void setSequenceIndex([[maybe_unused]] SequenceIndex *index) {
+    };
   };
 
   class TIME_LAPSE_API PipelineFileSource : public InputHandler, public PipelineSource {
     Q_OBJECT
   public:
     PipelineFileSource(const QStringList &inputArguments, const QStringList &fileSuffixes, bool recursive, QTextStream *verboseOutput, QTextStream *err);
+    virtual ~PipelineFileSource();
     virtual void process() override;
+    virtual void setFlowControl(FlowControl *flowControl) override;
+    virtual void setSequenceIndex(SequenceIndex *index) override;
+
+    /**
+     * Suffixes (lower case) of image files that are usually readable by the loader.
+     */
+    static QStringList imageSuffixes();
   protected:
-    QList<InputImageInfo> listDirectory(QDir d);
-    QList<InputImageInfo> parseArguments();
+    /**
+     * Start directory scanner, files are emitted while the scan is running.
+     */
+    void parseArguments();
   public slots:
     virtual void onInput(InputImageInfo info) override;
   private slots:
-    void takeNext(QList<InputImageInfo> inputs);
+    void takeNext();
+    void onCreditReleased();
+    void onScanProgress();
+    void onDirectoryListed(QString path, int entries);
   signals:
-    void processNext(QList<InputImageInfo> inputs);
+    void processNext();
 
   private:
     QStringList inputArguments;
@@ -60,5 +89,17 @@ namespace timelapse {
     bool recursive;
     QTextStream *verboseOutput;
     QTextStream *err;
+
+    FlowControl *flowControl=nullptr;
+    SequenceIndex *sequenceIndex=nullptr;
+    bool waitingForCredit=false;
+    bool hasPending=false;
+    InputImageInfo pending;
+
+    DirectoryScanner *scanner=nullptr;
+    bool waitingForScan=false;
+    int emitted=0;
+    QString firstSuffix;
+    bool suffixWarning=false;
   };
 }
@@ -104,11 +104,11 @@ namespace timelapse {
 
   public:
   public slots:
-    void onInputImg(InputImageInfo info, Magick::Image img) override;
+    void onInputImg(InputImageInfo info, Frame frame) override;
     void onLast();
 
   private:
-    void init(Magick::Image img);
+    void init(const Frame &frame);
 
     StabConfig *stabConf;
     bool initialized;
@@ -132,11 +132,11 @@ namespace timelapse {
 
   public:
   public slots:
-    virtual void onInputImg(InputImageInfo info, Magick::Image img) override;
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
     void onLast();
 
   private:
-    void init(Magick::Image img);
+    void init(const Frame &frame);
 
 
     VSFrameInfo fi;
@@ -0,0 +1,124 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+
+#include <QtCore/QString>
+#include <QtCore/QMutex>
+#include <QtCore/QJsonObject>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace timelapse {
+
+  /**
+   * Histogram of durations with logarithmic buckets (8 linear sub-buckets
+   * for every power of two microseconds), relative error of percentiles is under 7 %.
+   */
+  class TIME_LAPSE_API LatencyHistogram {
+  public:
+    void add(int64_t ns);
+
+    /**
+     * @param p percentile in range 0..1
+     * @return approximate duration in nanoseconds, 0 when histogram is empty
+     */
+    int64_t percentile(double p) const;
+
+    int64_t count() const {
+      return total;
+    }
+
+  private:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int BUCKETS = SUB_BUCKETS * 48;
+
+    static int bucket(int64_t us);
+    static int64_t bucketMiddle(int bucket);
+
+    std::array<int64_t, BUCKETS> buckets{};
+    int64_t total{0};
+  };
+
+  /**
+   * Performance counters of one pipeline stage. Counters may be updated
+   * from any thread.
+   */
+  class TIME_LAPSE_API StageStats {
+  public:
+    explicit StageStats(const QString &name);
+
+    /**
+     * Input was delivered to the stage.
+     * @param queueWaitNs time spent in the stage queue (threaded mode)
+     * @param bytes size of decoded frame, 0 for inputs without image
+     */
+    void onInput(int64_t queueWaitNs, int64_t bytes);
+    void onOutput();
+
+    /**
+     * Time spent by processing of one input, it is used as frame latency.
+     */
+    void onBusy(int64_t ns);
+
+    QString name() const;
+    void setName(const QString &name);
+    QJsonObject toJson() const;
+
+  private:
+    mutable QMutex mutex;
+    QString stageName;
+    int64_t framesIn{0};
+    int64_t framesOut{0};
+    int64_t bytes{0};
+    int64_t busyNs{0};
+    int64_t queueWaitNs{0};
+    LatencyHistogram latency;
+  };
+
+  /**
+   * Measures time spent in the current scope and report it as busy time of the stage.
+   * Handlers in non-threaded pipeline call next handler synchronously, time of nested
+   * timers in the same thread is subtracted, so every stage reports just its own work.
+   */
+  class TIME_LAPSE_API StageTimer {
+  public:
+    explicit StageTimer(StageStats *stats);
+    ~StageTimer();
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    static int64_t now();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    StageStats *stats;
+    StageTimer *parent;
+    Clock::time_point start;
+    int64_t nestedNs{0};
+  };
+
+}
@@ -0,0 +1,65 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/input_image_info.h>
+#include <TimeLapse/pipeline_handler.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QTextStream>
+
+#include <cstdint>
+#include <vector>
+
+namespace timelapse {
+
+  /**
+   * Sliding window average of last K frames ("long exposure", motion blur).
+   * Running sum of the window is updated by adding incoming frame and subtracting
+   * the frame leaving the window, so cost per frame doesn't depend on K.
+   * Accumulator is 16-bit for windows up to 257 frames, 32-bit otherwise.
+   *
+   * First frames are averaged over shorter window. When frame geometry changes,
+   * window is restarted.
+   */
+  class TIME_LAPSE_API TemporalAverage : public ImageHandler {
+    Q_OBJECT
+  public:
+    TemporalAverage(QTextStream *verboseOutput, int windowSize);
+
+  public slots:
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
+
+  private:
+    void reset(const Frame &frame);
+
+  private:
+    QTextStream *verboseOutput;
+    int windowSize;
+
+    QQueue<Frame> window;
+    std::vector<uint16_t> sum16;
+    std::vector<uint32_t> sum32;
+    FramePool pool;
+  };
+
+}
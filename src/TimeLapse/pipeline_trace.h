@@ -0,0 +1,105 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/input_image_info.h>
+
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QJsonDocument>
+
+#include <chrono>
+#include <cstdint>
+
+namespace timelapse {
+
+  /**
+   * Recorder of pipeline execution in Chrome trace-event format
+   * (it may be opened by chrome://tracing or https://ui.perfetto.dev).
+   * Events may be recorded from any thread.
+   */
+  class TIME_LAPSE_API TraceRecorder {
+  public:
+    TraceRecorder();
+
+    /**
+     * Microseconds since recorder creation.
+     */
+    int64_t now() const;
+
+    /**
+     * Complete event (span) on current thread.
+     * @param frame frame number, -1 when it is unknown
+     */
+    void span(const QString &name, int64_t start, int64_t duration, int frame = -1, const QString &file = QString());
+    void instant(const QString &name);
+    void counter(const QString &name, const QString &series, int64_t value);
+
+    QJsonDocument toJson() const;
+    bool write(const QString &file, QString *errorString = nullptr) const;
+
+  private:
+    struct Event {
+      char phase;
+      QString name;
+      int64_t ts;
+      int64_t duration;
+      int tid;
+      int frame;
+      QString file;
+      QString series;
+      int64_t value;
+    };
+
+    int currentThread();
+    void append(Event &&event);
+
+  private:
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start;
+
+    mutable QMutex mutex;
+    QList<Event> events;
+    QMap<int, QString> threadNames;
+  };
+
+  /**
+   * Records span of the current scope. Recorder may be null.
+   */
+  class TIME_LAPSE_API TraceSpan {
+  public:
+    TraceSpan(TraceRecorder *recorder, const QString &name, const InputImageInfo *info = nullptr);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+  private:
+    TraceRecorder *recorder;
+    QString name;
+    int frame{-1};
+    QString file;
+    int64_t start{0};
+  };
+
+}
@@ -22,6 +22,7 @@
 #include <TimeLapse/timelapse.h>
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/pipeline_write_frame.h>
 
 #include <Magick++.h>
 
@@ -32,12 +33,18 @@
 
 namespace timelapse {
 
+  /**
+   * Video assembly from frames stored in temporary directory.
+   * With variable frame rate, every frame is written just once and its duration
+   * (InputImageInfo::repeat) is passed to encoder via ffconcat list.
+   */
   class TIME_LAPSE_API VideoAssembly : public InputHandler {
     Q_OBJECT
   public:
     VideoAssembly(QDir tempDir, QTextStream *verboseOutput, QTextStream *err, bool dryRun,
                   QFileInfo output, int width, int height, float fps, QString bitrate, QString codec,
-                  QString builderBinary, QString pixelFormat="");
+                  QString builderBinary, QString pixelFormat="", bool variableFrameRate=false,
+                  FrameFormat frameFormat=FrameFormat());
     ~VideoAssembly() override;
 
   public slots:
@@ -52,6 +59,8 @@ namespace timelapse {
 
   private:
     QString getOrDetectBuilder();
+    QStringList imageSequenceArgs();
+    QStringList concatListArgs();
 
   private:
     QDir tempDir;
@@ -67,8 +76,56 @@ namespace timelapse {
     QString codec;
     QString builderBinary;
     QString pixelFormat;
+    bool variableFrameRate;
+    FrameFormat frameFormat;
 
+    QList<InputImageInfo> frames;
     QProcess *builderProc=nullptr;
   };
 
+  /**
+   * Video assembly that pipes raw frames to encoder standard input.
+   * Encoder is started with the first frame, so encoding runs concurrently
+   * with processing and frames are not stored to temporary directory.
+   */
+  class TIME_LAPSE_API StreamingVideoAssembly : public ImageHandler {
+    Q_OBJECT
+  public:
+    StreamingVideoAssembly(QTextStream *verboseOutput, QTextStream *err, bool dryRun,
+                           QFileInfo output, float fps, QString bitrate, QString codec,
+                           QString builderBinary, QString pixelFormat="");
+    ~StreamingVideoAssembly() override;
+
+  public slots:
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
+    virtual void onLast() override;
+
+    void onFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void onStdoutReady();
+
+  private:
+    bool startBuilder(const Frame &frame);
+    bool writeFrame(const Frame &frame, int repeat);
+
+  private:
+    QTextStream *verboseOutput;
+    QTextStream *err;
+    bool dryRun;
+
+    QFileInfo output;
+    float fps;
+    QString bitrate;
+    QString codec;
+    QString builderBinary;
+    QString pixelFormat;
+
+    QProcess *builderProc=nullptr;
+    bool failed=false;
+    bool lastReceived=false;
+    int width=-1;
+    int height=-1;
+    int channels=-1;
+    int64_t frameCount=0;
+  };
+
 }
@@ -0,0 +1,113 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/input_image_info.h>
+#include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/pipeline_source.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+
+#include <cstdint>
+
+namespace timelapse {
+
+  constexpr int64_t DEFAULT_WATCH_TIMEOUT_MS = 5 * 60 * 1000;
+  /* existing file modified recently may be still written, it waits for close or for this time without change */
+  constexpr int64_t WATCH_SETTLE_MS = 2000;
+
+  /**
+   * Source that watches directory (inotify, Linux only) and emits images
+   * as they are completed (closed after write or moved to the directory).
+   * Files existing in the directory are emitted first, files modified within
+   * WATCH_SETTLE_MS are emitted when they are closed or not modified for this time.
+   * When no suffix is given,
+   * just files with image suffix (PipelineFileSource::imageSuffixes) are emitted,
+   * so sidecar and temporary files written by cameras or rsync are ignored.
+   *
+   * Last is emitted when sentinel file appears in the directory or when
+   * there is no new image for quiescence timeout. Zero timeout or empty
+   * sentinel disables given condition.
+   */
+  class TIME_LAPSE_API PipelineWatchSource : public InputHandler, public PipelineSource {
+    Q_OBJECT
+  public:
+    PipelineWatchSource(const QString &directory, const QStringList &fileSuffixes,
+                        int64_t quiescenceMs, const QString &sentinel,
+                        QTextStream *verboseOutput, QTextStream *err);
+    virtual ~PipelineWatchSource();
+
+    virtual void process() override;
+    virtual void setFlowControl(FlowControl *flowControl) override;
+    virtual void setSequenceIndex(SequenceIndex *index) override;
+
+  public slots:
+    virtual void onInput(InputImageInfo info) override;
+  private slots:
+    void takeNext();
+    void onCreditReleased();
+    void onNotification();
+    void onQuiescence();
+    void onSettleTimeout();
+  signals:
+    void processNext();
+
+  private:
+    bool acceptFile(const QString &name) const;
+    void enqueue(const QString &name);
+    /* enqueue settling files that were not modified for settle time (all when force is set) */
+    void enqueueSettled(bool force);
+    void schedule();
+    void finish();
+    void stopWatching();
+
+  private:
+    QDir directory;
+    QStringList fileSuffixes;
+    int64_t quiescenceMs;
+    QString sentinel;
+    QTextStream *verboseOutput;
+    QTextStream *err;
+
+    FlowControl *flowControl=nullptr;
+    SequenceIndex *sequenceIndex=nullptr;
+    bool waitingForCredit=false;
+    bool scheduled=false;
+    bool finished=false;
+    bool lastEmitted=false;
+
+    int inotifyFd=-1;
+    QSocketNotifier *notifier=nullptr;
+    QTimer *quiescenceTimer=nullptr;
+    QTimer *settleTimer=nullptr;
+
+    QQueue<InputImageInfo> queue;
+    QSet<QString> seen;
+    /* existing files that may be still written */
+    QSet<QString> settling;
+  };
+}
@@ -0,0 +1,128 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/input_image_info.h>
+#include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/pipeline_stats.h>
+#include <TimeLapse/pipeline_trace.h>
+
+#include <Magick++.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include <functional>
+
+namespace timelapse {
+
+  typedef std::function<ImageHandler*(QTextStream *verboseOutput, QTextStream *err)> ImageHandlerFactory;
+
+  /**
+   * Pool of identical image handlers, every one running in its own thread.
+   * It may be used just for stateless handlers (ResizeFrame, AdjustLuminance...)
+   * that don't depend on previous frames.
+   *
+   * Frames are processed concurrently, but results are emitted in the same
+   * order as inputs arrived (reorder buffer). So stateful handlers connected
+   * after the pool still see strictly ordered stream of frames.
+   */
+  class TIME_LAPSE_API ImageHandlerPool : public ImageHandler {
+    Q_OBJECT
+  public:
+    ImageHandlerPool(int workerCount, ImageHandlerFactory factory,
+                     QTextStream *verboseOutput, QTextStream *err);
+    virtual ~ImageHandlerPool();
+
+    /**
+     * Stats that collects busy time of workers. It has to be set before processing.
+     */
+    void setStats(StageStats *stats);
+    void setTrace(TraceRecorder *trace);
+
+    /**
+     * Configure worker handlers, it has to be called before processing.
+     */
+    void forEachHandler(std::function<void(ImageHandler*)> function);
+
+    /**
+     * Stop worker threads and move worker handlers to given threads (one thread per worker).
+     * It is used when the handlers are fused into handlers of another pool,
+     * the pool can't process frames after that. It has to be called before processing.
+     */
+    void stopWorkers(const QList<QThread*> &targets);
+
+    virtual bool scaleInvariant() const override;
+    virtual QSize outputSize() const override;
+    virtual bool pixelsRequired(const InputImageInfo &info) const override;
+
+  public slots:
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
+    /**
+     * Dispatch input without image. It is usable just for handlers
+     * that are loading the image by itself (ImageLoader).
+     */
+    void onInput(InputImageInfo info);
+    virtual void onLast() override;
+
+  private:
+    struct Worker {
+      QThread *thread{nullptr};
+      ImageHandler *handler{nullptr};
+      QTextStream *verboseOutput{nullptr};
+      QTextStream *err{nullptr};
+      qint64 sequence{-1};
+    };
+
+    struct Result {
+      bool done{false};
+      QList<QPair<InputImageInfo, Frame>> outputs;
+    };
+
+    void onWorkerOutput(Worker *worker, InputImageInfo info, Frame frame);
+    void onWorkerDone(Worker *worker, qint64 sequence);
+
+    /**
+     * Emit all finished results in input order. It has to be called from pool thread.
+     */
+    void drain();
+    bool headDone() const;
+
+  private:
+    QList<Worker*> workers;
+    int capacity;
+    StageStats *stats{nullptr};
+    TraceRecorder *trace{nullptr};
+
+    QMutex mutex;
+    QWaitCondition condition;
+    QList<Worker*> idle;
+    QMap<qint64, Result> results;
+    qint64 nextSequence{0};
+    qint64 nextEmit{0};
+  };
+
+}
@@ -22,27 +22,127 @@
 #include <TimeLapse/timelapse.h>
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/async_file_writer.h>
 
 #include <Magick++.h>
 
 #include <QtCore/QObject>
 #include <QtCore/QDebug>
 #include <QtCore/QTemporaryDir>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QThreadPool>
 
 namespace timelapse {
 
+  /**
+   * File format of written frames. Raw formats (PPM, PAM) are cheap to write and read,
+   * they are suitable for intermediate frames that are read just once.
+   */
+  class TIME_LAPSE_API FrameFormat {
+  public:
+    enum Type {
+      Jpeg,
+      Png,
+      Ppm,
+      Pam
+    };
+
+    /**
+     * Parse format specification: "ppm", "pam", "png[:level]" or "jpeg[:quality[:subsampling]]",
+     * where level is zlib compression level (0-9), quality is JPEG quality (1-100)
+     * and subsampling is chroma subsampling (420, 422 or 444).
+     */
+    static FrameFormat parse(const QString &spec, bool *ok);
+
+    QString suffix() const;
+
+    /**
+     * Encode frame to file content. It may throw Magick::Exception.
+     */
+    QByteArray encode(const Frame &frame) const;
+
+    Type type{Jpeg};
+    /* JPEG quality or PNG compression level, -1 for library default */
+    int quality{-1};
+    /* JPEG chroma subsampling factor ("2x2", "2x1", "1x1"), empty for library default */
+    QString samplingFactor;
+  };
+
   class TIME_LAPSE_API WriteFrame : public ImageHandler {
     Q_OBJECT
   public:
-    WriteFrame(QDir outputDir, QTextStream *verboseOutput, bool dryRun);
+    WriteFrame(QDir outputDir, QTextStream *verboseOutput, bool dryRun, bool repeatFrames=true,
+               FrameFormat format=FrameFormat());
     QString leadingZeros(int i, int leadingZeros);
   public slots:
-    virtual void onInputImg(InputImageInfo info, Magick::Image img) override;
-  private:
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
+  protected:
+    QString framePath(int frame);
+    void repeatFrame(const QString &source, const QString &target);
+    void writeImage(const Frame &frame, const QString &path);
+
     QDir outputDir;
     QLocale frameNumberLocale;
     QTextStream *verboseOutput;
     bool dryRun;
+    bool repeatFrames;
+    FrameFormat format;
+  };
+
+  /**
+   * Frame writer that doesn't block the pipeline on encoding and disk latency.
+   * Frames are encoded on thread pool and written by AsyncFileWriter,
+   * frame is emitted (in original order) as soon as its write is queued.
+   * When too many writes are pending, frames are held back (with their credit)
+   * and when too many frames are held back, input blocks until the writer catches up.
+   * Last is emitted after all writes are finished.
+   */
+  class TIME_LAPSE_API AsyncWriteFrame : public WriteFrame {
+    Q_OBJECT
+  public:
+    AsyncWriteFrame(QDir outputDir, QTextStream *verboseOutput, QTextStream *err, bool dryRun,
+                    bool repeatFrames=true, FrameFormat format=FrameFormat(),
+                    int threads=DEFAULT_WRITER_THREADS);
+    virtual ~AsyncWriteFrame();
+
+  public slots:
+    virtual void onInputImg(InputImageInfo info, Frame frame) override;
+    virtual void onLast() override;
+
+  private slots:
+    void onWritten(uint64_t id, QString path, QString error);
+
+  private:
+    struct Entry {
+      InputImageInfo info;
+      Frame frame;
+      QString path;
+      bool done{false};
+      QByteArray data;
+      QString error;
+    };
+
+    /* queue writes of encoded frames from head of the queue and emit them */
+    void drain();
+    void checkLast();
+
+  private:
+    QTextStream *err;
+    QThreadPool *encoders;
+    AsyncFileWriter *writer;
+    int maxPendingWrites;
+
+    QMutex mutex;
+    QWaitCondition encoded;
+    /* frames waiting for encoding or for the writer, bounded by maxPendingWrites */
+    QList<QSharedPointer<Entry>> queue;
+    /* repeat count of pending writes, frame is linked when it is written */
+    QHash<uint64_t, InputImageInfo> writes;
+    bool lastReceived=false;
   };
 
 }
@@ -0,0 +1,53 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QIODevice>
+#include <QtCore/QTextStream>
+
+namespace timelapse {
+
+  /**
+   * QueuedOutputDevice is write-only device that forwards all written data
+   * to the target text stream in the thread of the context object.
+   *
+   * QTextStream is not thread-safe, so every pipeline stage running
+   * in its own thread writes to its own stream backed by this device
+   * and all the output is serialized in the main thread.
+   */
+  class TIME_LAPSE_API QueuedOutputDevice : public QIODevice {
+    Q_OBJECT
+    Q_DISABLE_COPY(QueuedOutputDevice)
+
+  public:
+    QueuedOutputDevice(QTextStream *target, QObject *context);
+    virtual ~QueuedOutputDevice();
+
+    virtual qint64 readData(char *data, qint64 maxlen);
+    virtual qint64 writeData(const char *data, qint64 len);
+
+  private:
+    QTextStream *target;
+    QObject *context;
+  };
+}
@@ -0,0 +1,94 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/frame.h>
+
+#include <QtCore/QString>
+#include <QtCore/QThreadPool>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace timelapse {
+
+  /**
+   * Separable resampler of 8-bit frames. Filter weights are computed once
+   * for given source and target geometry and reused for following frames
+   * with the same geometry (common case of image sequence).
+   *
+   * Horizontal pass is followed by vertical one, rows of each pass are split
+   * between threads. Resampler is not thread safe, use one instance per thread.
+   */
+  class TIME_LAPSE_API Resampler {
+  public:
+    enum Filter {
+      /* area average, exact for integer ratios */
+      Box,
+      Bilinear,
+      Lanczos3
+    };
+
+    /**
+     * Parse filter name: box, bilinear or lanczos3.
+     */
+    static Filter parseFilter(const QString &name, bool *ok);
+
+    explicit Resampler(Filter filter, int threads = 1);
+    ~Resampler();
+
+    Resampler(const Resampler&) = delete;
+    Resampler &operator=(const Resampler&) = delete;
+
+    /**
+     * Resize frame to given geometry. Result is interleaved frame.
+     */
+    Frame resize(const Frame &frame, int width, int height);
+
+  private:
+    /* fixed point weights of one direction */
+    struct Weights {
+      int srcSize{-1};
+      int dstSize{-1};
+      int taps{0};
+      /* first source sample of every target sample */
+      std::vector<int> start;
+      /* count of used taps of every target sample */
+      std::vector<int> count;
+      /* dstSize * taps weights, sum of weights for one target sample is 1 << WEIGHT_BITS */
+      std::vector<int16_t> weights;
+    };
+
+    void computeWeights(Weights &w, int srcSize, int dstSize) const;
+    void horizontalPass(const Frame &src, Frame &dst, int y0, int y1) const;
+    void verticalPass(const Frame &src, Frame &dst, int y0, int y1) const;
+    void runParallel(int rows, const std::function<void(int, int)> &pass);
+
+  private:
+    Filter filter;
+    int threads;
+    QThreadPool *pool{nullptr};
+    Weights horizontal;
+    Weights vertical;
+  };
+
+}
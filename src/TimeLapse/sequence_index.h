@@ -0,0 +1,106 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#pragma once
+
+#include <TimeLapse/timelapse.h>
+#include <TimeLapse/input_image_info.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QTextStream>
+
+#include <cstdint>
+
+namespace timelapse {
+
+  /**
+   * Index of image metadata kept in sidecar file in every input directory.
+   *
+   * Index stores file size and modification time (to detect changed files),
+   * image dimensions, timestamp and measured luminance. Metadata of indexed
+   * files are filled to InputImageInfo by the source, so stages may skip
+   * reading of EXIF or computing luminance. Stages record new values and
+   * modified indexes are written when the pipeline is done.
+   *
+   * Methods are thread safe.
+   */
+  class TIME_LAPSE_API SequenceIndex {
+  public:
+    static constexpr char const *FILE_NAME = ".timelapse.index";
+
+    SequenceIndex(QTextStream *verboseOutput, QTextStream *err);
+
+    SequenceIndex(const SequenceIndex &) = delete;
+    SequenceIndex &operator=(const SequenceIndex &) = delete;
+
+    /**
+     * Luminance of following updates is measured on 1/8 scaled images. Such values
+     * are not used by lookups of runs that measure luminance in full resolution.
+     */
+    void setFastLuminance(bool fast);
+
+    /**
+     * Fill known metadata of the file.
+     * @return true when index contains up to date entry for the file
+     */
+    bool lookup(InputImageInfo &info);
+
+    /**
+     * Record valid metadata of the file (dimensions, timestamp, luminance).
+     */
+    void update(const InputImageInfo &info);
+
+    /**
+     * Write modified indexes, entries of removed files are dropped.
+     */
+    bool save();
+
+  private:
+    struct Entry {
+      int64_t size{-1};
+      int64_t modified{-1};
+      int width{-1};
+      int height{-1};
+      QDateTime timestamp;
+      double luminance{-1};
+      bool fastLuminance{false};
+    };
+
+    struct DirectoryIndex {
+      QMap<QString, Entry> entries;
+      bool dirty{false};
+    };
+
+    /* it expects locked mutex */
+    DirectoryIndex &directory(const QString &path);
+    void load(const QString &path, DirectoryIndex &index);
+    bool save(const QString &path, const DirectoryIndex &index);
+
+  private:
+    QTextStream *verboseOutput;
+    QTextStream *err;
+    QMutex mutex;
+    bool fastLuminance{false};
+    QMap<QString, DirectoryIndex> directories;
+  };
+
+}
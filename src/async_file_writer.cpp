@@ -0,0 +1,284 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/async_file_writer.h>
+
+#include <QtCore/QFile>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace timelapse;
+
+namespace timelapse {
+
+  namespace {
+#ifdef HAVE_LIBURING
+    constexpr unsigned RING_QUEUE_DEPTH = 64;
+#endif
+
+    class WriteTask : public QRunnable {
+    public:
+      WriteTask(QString path, QByteArray data, std::function<void(const QString&)> done) :
+      path(path), data(data), done(done) {
+        setAutoDelete(true);
+      }
+
+      void run() override {
+        QFile file(path);
+        QString error;
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+          error = file.errorString();
+        } else if (file.write(data) != data.size()) {
+          error = file.errorString();
+        }
+        done(error);
+      }
+
+    private:
+      QString path;
+      QByteArray data;
+      std::function<void(const QString&)> done;
+    };
+  }
+
+  AsyncFileWriter::AsyncFileWriter(int threads, QObject *parent) :
+  QObject(parent), pool(new QThreadPool(this)) {
+    if (threads <= 0) {
+      throw std::invalid_argument("Writer thread count have to be positive!");
+    }
+    pool->setMaxThreadCount(threads);
+  }
+
+  AsyncFileWriter::~AsyncFileWriter() {
+    // nobody is listening anymore, just wait for pending writes
+    disconnect(this, &AsyncFileWriter::written, nullptr, nullptr);
+    pool->waitForDone();
+#ifdef HAVE_LIBURING
+    if (ring != nullptr) {
+      while (!requests.isEmpty()) {
+        reapCompletions(true);
+      }
+      io_uring_queue_exit(ring);
+      delete ring;
+      ring = nullptr;
+    }
+    if (eventFd >= 0) {
+      ::close(eventFd);
+    }
+#endif
+  }
+
+  int AsyncFileWriter::pending() const {
+    return pendingCount;
+  }
+
+  void AsyncFileWriter::finish(uint64_t id, const QString &path, const QString &error) {
+    {
+      QMutexLocker locker(&completedMutex);
+      completed.append(Completion{id, path, error});
+      completedCondition.wakeAll();
+    }
+    // caller of write may not be ready for the signal yet, deliver it from event loop
+    QMetaObject::invokeMethod(this, [this]() {
+      deliver();
+    }, Qt::QueuedConnection);
+  }
+
+  void AsyncFileWriter::deliver() {
+    QList<Completion> done;
+    {
+      QMutexLocker locker(&completedMutex);
+      done = completed;
+      completed.clear();
+    }
+    for (const Completion &completion : done) {
+      pendingCount--;
+      emit written(completion.id, completion.path, completion.error);
+    }
+  }
+
+  void AsyncFileWriter::waitForWritten() {
+    if (pendingCount == 0) {
+      return;
+    }
+    for (;;) {
+      QMutexLocker locker(&completedMutex);
+      if (!completed.isEmpty()) {
+        break;
+      }
+      if (ring != nullptr && !requests.isEmpty()) {
+        locker.unlock();
+        reapCompletions(true);
+      } else {
+        completedCondition.wait(&completedMutex);
+      }
+    }
+    deliver();
+  }
+
+  bool AsyncFileWriter::initRing() {
+#ifdef HAVE_LIBURING
+    // ring is created lazily, in the thread where writer lives
+    ringInitialized = true;
+    ring = new io_uring();
+    if (io_uring_queue_init(RING_QUEUE_DEPTH, ring, 0) < 0) {
+      // kernel without io_uring support (or disabled by seccomp)
+      delete ring;
+      ring = nullptr;
+      return false;
+    }
+    eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0 || io_uring_register_eventfd(ring, eventFd) < 0) {
+      if (eventFd >= 0) {
+        ::close(eventFd);
+        eventFd = -1;
+      }
+      io_uring_queue_exit(ring);
+      delete ring;
+      ring = nullptr;
+      return false;
+    }
+    notifier = new QSocketNotifier(eventFd, QSocketNotifier::Read, this);
+    // string based connection, activated signal is overloaded since Qt 5.15
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(onRingNotification()));
+    return true;
+#else
+    ringInitialized = true;
+    return false;
+#endif
+  }
+
+  uint64_t AsyncFileWriter::write(const QString &path, const QByteArray &data) {
+    uint64_t id = nextId++;
+    pendingCount++;
+
+    if (!ringInitialized) {
+      initRing();
+    }
+#ifdef HAVE_LIBURING
+    if (ring != nullptr) {
+      Request request;
+      request.path = path;
+      request.data = data;
+      request.fd = ::open(QFile::encodeName(path).constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (request.fd < 0) {
+        finish(id, path, QString::fromLocal8Bit(strerror(errno)));
+        return id;
+      }
+      requests.insert(id, request);
+      submit(id);
+      return id;
+    }
+#endif
+
+    pool->start(new WriteTask(path, data, [this, id, path](const QString &error) {
+      finish(id, path, error);
+    }));
+    return id;
+  }
+
+  bool AsyncFileWriter::submit([[maybe_unused]] uint64_t id) {
+#ifdef HAVE_LIBURING
+    io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    while (sqe == nullptr) {
+      // submission queue is full, wait for some completion
+      io_uring_submit(ring);
+      reapCompletions(true);
+      sqe = io_uring_get_sqe(ring);
+    }
+    const Request &request = requests[id];
+    io_uring_prep_write(sqe, request.fd,
+                        request.data.constData() + request.offset,
+                        request.data.size() - request.offset,
+                        request.offset);
+    io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(id)));
+    int res = io_uring_submit(ring);
+    if (res < 0) {
+      complete(id, QString::fromLocal8Bit(strerror(-res)));
+      return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void AsyncFileWriter::onRingNotification() {
+#ifdef HAVE_LIBURING
+    eventfd_t value;
+    eventfd_read(eventFd, &value);
+    reapCompletions(false);
+#endif
+  }
+
+  void AsyncFileWriter::reapCompletions([[maybe_unused]] bool wait) {
+#ifdef HAVE_LIBURING
+    io_uring_cqe *cqe = nullptr;
+    int res = wait ? io_uring_wait_cqe(ring, &cqe) : io_uring_peek_cqe(ring, &cqe);
+    while (res == 0 && cqe != nullptr) {
+      uint64_t id = reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe));
+      int written = cqe->res;
+      io_uring_cqe_seen(ring, cqe);
+
+      auto it = requests.find(id);
+      if (it != requests.end()) {
+        if (written < 0) {
+          complete(id, QString::fromLocal8Bit(strerror(-written)));
+        } else if (written == 0) {
+          complete(id, "No data written");
+        } else {
+          it->offset += written;
+          if (it->offset < it->data.size()) {
+            // short write, submit the rest
+            submit(id);
+          } else {
+            complete(id, QString());
+          }
+        }
+      }
+      cqe = nullptr;
+      res = io_uring_peek_cqe(ring, &cqe);
+    }
+#endif
+  }
+
+  void AsyncFileWriter::complete([[maybe_unused]] uint64_t id, [[maybe_unused]] const QString &error) {
+#ifdef HAVE_LIBURING
+    Request request = requests.take(id);
+    if (request.fd >= 0) {
+      ::close(request.fd);
+    }
+    finish(id, request.path, error);
+#endif
+  }
+
+}
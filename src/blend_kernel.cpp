@@ -0,0 +1,170 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/blend_kernel.h>
+
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TIMELAPSE_BLEND_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TIMELAPSE_BLEND_NEON
+#endif
+
+namespace timelapse {
+
+  namespace {
+    typedef void (*CrossfadeFn)(const uint8_t*, const uint8_t*, uint8_t*, size_t, uint32_t);
+
+    void crossfadeScalar(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t count, uint32_t weightA) {
+      uint32_t weightB = 256 - weightA;
+      for (size_t i = 0; i < count; i++) {
+        out[i] = (uint8_t) ((a[i] * weightA + b[i] * weightB + 128) >> 8);
+      }
+    }
+
+    // a * weightA + b * weightB + 128 <= 255 * 256 + 128, so 16-bit lanes don't overflow
+
+#if defined(TIMELAPSE_BLEND_X86) && defined(__SSE2__)
+    void crossfadeSse2(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t count, uint32_t weightA) {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i wa = _mm_set1_epi16((short) weightA);
+      const __m128i wb = _mm_set1_epi16((short) (256 - weightA));
+      const __m128i round = _mm_set1_epi16(128);
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+      }
+      crossfadeScalar(a + i, b + i, out + i, count - i, weightA);
+    }
+#endif
+
+#if defined(TIMELAPSE_BLEND_X86) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    void crossfadeAvx2(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t count, uint32_t weightA) {
+      const __m256i zero = _mm256_setzero_si256();
+      const __m256i wa = _mm256_set1_epi16((short) weightA);
+      const __m256i wb = _mm256_set1_epi16((short) (256 - weightA));
+      const __m256i round = _mm256_set1_epi16(128);
+      size_t i = 0;
+      // unpack and pack work within 128-bit lanes, so byte order is preserved
+      for (; i + 32 <= count; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+                                      _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), wb));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+                                      _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), wb));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_packus_epi16(lo, hi));
+      }
+      crossfadeScalar(a + i, b + i, out + i, count - i, weightA);
+    }
+#endif
+
+#if defined(TIMELAPSE_BLEND_NEON)
+    void crossfadeNeon(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t count, uint32_t weightA) {
+      const uint16x8_t wa = vdupq_n_u16((uint16_t) weightA);
+      const uint16x8_t wb = vdupq_n_u16((uint16_t) (256 - weightA));
+      size_t i = 0;
+      for (; i + 16 <= count; i += 16) {
+        uint8x16_t va = vld1q_u8(a + i);
+        uint8x16_t vb = vld1q_u8(b + i);
+        uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(va)), wa), vmovl_u8(vget_low_u8(vb)), wb);
+        uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(va)), wa), vmovl_u8(vget_high_u8(vb)), wb);
+        // rounding shift: (x + 128) >> 8
+        vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+      }
+      crossfadeScalar(a + i, b + i, out + i, count - i, weightA);
+    }
+#endif
+
+    struct Implementation {
+      CrossfadeFn fn;
+      const char *name;
+    };
+
+    // supported implementations ordered by preference, scalar is always the last
+    std::vector<Implementation> supported() {
+      std::vector<Implementation> result;
+#if defined(TIMELAPSE_BLEND_X86) && defined(__GNUC__)
+      if (__builtin_cpu_supports("avx2")) {
+        result.push_back({crossfadeAvx2, "avx2"});
+      }
+#endif
+#if defined(TIMELAPSE_BLEND_X86) && defined(__SSE2__)
+      result.push_back({crossfadeSse2, "sse2"});
+#elif defined(TIMELAPSE_BLEND_NEON)
+      result.push_back({crossfadeNeon, "neon"});
+#endif
+      result.push_back({crossfadeScalar, "scalar"});
+      return result;
+    }
+
+    const Implementation &implementation() {
+      static const Implementation impl = supported().front();
+      return impl;
+    }
+  }
+
+  void crossfade(const uint8_t *a, const uint8_t *b, uint8_t *out, size_t count, uint32_t weightA) {
+    if (weightA > 256) {
+      weightA = 256;
+    }
+    implementation().fn(a, b, out, count, weightA);
+  }
+
+  const char *crossfadeImplementation() {
+    return implementation().name;
+  }
+
+  std::vector<const char*> crossfadeImplementations() {
+    std::vector<const char*> result;
+    for (const Implementation &impl: supported()) {
+      result.push_back(impl.name);
+    }
+    return result;
+  }
+
+  bool crossfade(const char *implementation, const uint8_t *a, const uint8_t *b, uint8_t *out, size_t count, uint32_t weightA) {
+    if (weightA > 256) {
+      weightA = 256;
+    }
+    for (const Implementation &impl: supported()) {
+      if (std::strcmp(impl.name, implementation) == 0) {
+        impl.fn(a, b, out, count, weightA);
+        return true;
+      }
+    }
+    return false;
+  }
+
+}
@@ -0,0 +1,209 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/decoded_frame_cache.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace timelapse {
+
+  namespace {
+    // bump the version when format or decoding changes
+    constexpr char FRAME_CACHE_MAGIC[8] = {'T', 'L', 'F', 'R', 'A', 'M', 'E', '1'};
+    constexpr char FRAME_CACHE_SUFFIX[] = ".frame";
+
+    struct FrameCacheHeader {
+      char magic[8];
+      uint32_t width;
+      uint32_t height;
+      uint32_t channels;
+      uint32_t layout;
+      uint32_t depth;
+      uint32_t reserved;
+    };
+
+    int lineBytes(int width, int channels, Frame::Layout layout) {
+      return layout == Frame::Planar ? width : width * channels;
+    }
+
+    int planeCount(int channels, Frame::Layout layout) {
+      return layout == Frame::Planar ? channels : 1;
+    }
+  }
+
+  DecodedFrameCache::DecodedFrameCache(const QDir &_dir, int64_t maxBytes) :
+  dir(_dir), limit(maxBytes) {
+    if (limit <= 0) {
+      throw std::invalid_argument("Frame cache size have to be positive!");
+    }
+    if (!dir.mkpath(".")) {
+      throw std::invalid_argument(QString("Can't create frame cache directory %1").arg(dir.path()).toStdString());
+    }
+    for (const QFileInfo &entry : dir.entryInfoList(QStringList() << QString("*") + FRAME_CACHE_SUFFIX, QDir::Files)) {
+      usedBytes += entry.size();
+    }
+  }
+
+  QDir DecodedFrameCache::directory() const {
+    return dir;
+  }
+
+  int64_t DecodedFrameCache::maxBytes() const {
+    return limit;
+  }
+
+  QString DecodedFrameCache::entryPath(const InputImageInfo &info, const QSize &sizeHint, bool preview) const {
+    QFileInfo fileInfo = info.fileInfo();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray(FRAME_CACHE_MAGIC, sizeof(FRAME_CACHE_MAGIC)));
+    hash.addData(fileInfo.absoluteFilePath().toUtf8());
+    hash.addData(QString("|%1|%2|%3x%4|%5")
+      .arg(fileInfo.size())
+      .arg(fileInfo.lastModified().toMSecsSinceEpoch())
+      .arg(sizeHint.isValid() ? sizeHint.width() : 0)
+      .arg(sizeHint.isValid() ? sizeHint.height() : 0)
+      .arg(preview ? 1 : 0)
+      .toUtf8());
+    return dir.filePath(QString::fromLatin1(hash.result().toHex()) + FRAME_CACHE_SUFFIX);
+  }
+
+  bool DecodedFrameCache::load(const InputImageInfo &info, const QSize &sizeHint, bool preview,
+    Frame &frame, size_t &depth) {
+
+    QFile file(entryPath(info, sizeHint, preview));
+    if (!file.open(QIODevice::ReadOnly)) {
+      return false;
+    }
+    FrameCacheHeader header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header) ||
+        std::memcmp(header.magic, FRAME_CACHE_MAGIC, sizeof(FRAME_CACHE_MAGIC)) != 0 ||
+        header.width == 0 || header.height == 0 || header.channels == 0 ||
+        header.layout > Frame::Planar) {
+      return false;
+    }
+    Frame::Layout layout = static_cast<Frame::Layout>(header.layout);
+    int width = header.width;
+    int height = header.height;
+    int channels = header.channels;
+    int bytes = lineBytes(width, channels, layout);
+    int planes = planeCount(channels, layout);
+    if (file.size() != (int64_t) sizeof(header) + (int64_t) planes * height * bytes) {
+      // truncated or foreign file
+      return false;
+    }
+
+    Frame result(width, height, channels, layout);
+    for (int p = 0; p < planes; p++) {
+      for (int y = 0; y < height; y++) {
+        if (file.read(reinterpret_cast<char*>(result.line(y, p)), bytes) != bytes) {
+          return false;
+        }
+      }
+    }
+
+    // entry was used, it is the most recent one now (setFileTime requires open file)
+    if (!file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime)) {
+      qWarning() << "Can't update modification time of frame cache entry" << file.fileName() << file.errorString();
+    }
+    file.close();
+
+    frame = result;
+    depth = header.depth;
+    return true;
+  }
+
+  void DecodedFrameCache::store(const InputImageInfo &info, const QSize &sizeHint, bool preview,
+    const Frame &frame, size_t depth) {
+
+    if (frame.isNull()) {
+      return;
+    }
+    QString path = entryPath(info, sizeHint, preview);
+    if (QFileInfo::exists(path)) {
+      // stored by another process in the meantime
+      return;
+    }
+
+    FrameCacheHeader header;
+    std::memcpy(header.magic, FRAME_CACHE_MAGIC, sizeof(FRAME_CACHE_MAGIC));
+    header.width = frame.width();
+    header.height = frame.height();
+    header.channels = frame.channels();
+    header.layout = frame.layout();
+    header.depth = depth;
+    header.reserved = 0;
+
+    int bytes = lineBytes(frame.width(), frame.channels(), frame.layout());
+    int planes = planeCount(frame.channels(), frame.layout());
+
+    // save file writes into temporary file and renames it on commit,
+    // readers never see partially written entry
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+      return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (int p = 0; p < planes; p++) {
+      for (int y = 0; y < frame.height(); y++) {
+        file.write(reinterpret_cast<const char*>(frame.constLine(y, p)), bytes);
+      }
+    }
+    if (!file.commit()) {
+      return;
+    }
+
+    QMutexLocker locker(&mutex);
+    usedBytes += (int64_t) sizeof(header) + (int64_t) planes * frame.height() * bytes;
+    if (usedBytes > limit) {
+      evict();
+    }
+  }
+
+  void DecodedFrameCache::evict() {
+    // other processes may modify the directory, so recompute the usage from the directory listing
+    QFileInfoList entries = dir.entryInfoList(QStringList() << QString("*") + FRAME_CACHE_SUFFIX,
+                                              QDir::Files, QDir::Time | QDir::Reversed);
+    usedBytes = 0;
+    for (const QFileInfo &entry : entries) {
+      usedBytes += entry.size();
+    }
+    // remove oldest entries, leave some free space to avoid eviction after every store
+    int64_t target = limit - limit / 10;
+    for (const QFileInfo &entry : entries) {
+      if (usedBytes <= target) {
+        break;
+      }
+      if (QFile::remove(entry.absoluteFilePath())) {
+        usedBytes -= entry.size();
+      }
+    }
+  }
+
+}
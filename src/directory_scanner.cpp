@@ -0,0 +1,290 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/directory_scanner.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace timelapse {
+
+  namespace {
+    class ScanTask : public QRunnable {
+    public:
+      explicit ScanTask(std::function<void()> scan) : scan(scan) {
+        setAutoDelete(true);
+      }
+
+      void run() override {
+        scan();
+      }
+
+    private:
+      std::function<void()> scan;
+    };
+
+#ifdef __linux__
+    struct LinuxDirent64 {
+      ino64_t d_ino;
+      off64_t d_off;
+      unsigned short d_reclen;
+      unsigned char d_type;
+      // records are variable length, name is null terminated and may be shorter (as glibc dirent64)
+      char d_name[256];
+    };
+
+    constexpr size_t DIRENT_BUFFER_SIZE = 256 * 1024;
+#endif
+  }
+
+  DirectoryScanner::DirectoryScanner(const QStringList &fileSuffixes, bool recursive, int threads) :
+  recursive(recursive), pool(new QThreadPool()) {
+    if (threads <= 0) {
+      throw std::invalid_argument("Scanner thread count have to be positive!");
+    }
+    pool->setMaxThreadCount(threads);
+    for (const QString &suffix : fileSuffixes) {
+      suffixes.append(suffix.toLower().toUtf8());
+    }
+    root = createNode(QString());
+  }
+
+  DirectoryScanner::~DirectoryScanner() {
+    pool->waitForDone();
+    delete pool;
+  }
+
+  DirectoryScanner::Node *DirectoryScanner::createNode(const QString &path) {
+    nodes.emplace_back(new Node());
+    Node *node = nodes.back().get();
+    node->path = path;
+    return node;
+  }
+
+  void DirectoryScanner::addFile(const QString &path) {
+    Entry entry;
+    entry.path = path;
+    root->entries.append(entry);
+  }
+
+  void DirectoryScanner::addDirectory(const QString &path) {
+    Entry entry;
+    entry.path = path;
+    entry.directory = createNode(path);
+    root->entries.append(entry);
+  }
+
+  void DirectoryScanner::start() {
+    QMutexLocker locker(&mutex);
+    root->done = true;
+    cursor.append(qMakePair(root, 0));
+    for (const Entry &entry : root->entries) {
+      if (entry.directory != nullptr) {
+        submit(entry.directory);
+      }
+    }
+  }
+
+  void DirectoryScanner::submit(Node *node) {
+    pool->start(new ScanTask([this, node]() {
+      scan(node);
+    }));
+  }
+
+  void DirectoryScanner::scan(Node *node) {
+    QStringList files;
+    QStringList directories;
+    QString errorMessage;
+    bool ok = list(node->path, files, directories, errorMessage);
+
+    // merge files and subdirectories by name, like sequential listing
+    QList<Entry> entries;
+    QList<Node*> subdirectories;
+    {
+      QMutexLocker locker(&mutex);
+      int f = 0;
+      int d = 0;
+      QDir dir(node->path);
+      while (f < files.size() || d < directories.size()) {
+        Entry entry;
+        if (d >= directories.size() || (f < files.size() && files[f] < directories[d])) {
+          entry.path = dir.filePath(files[f++]);
+        } else {
+          entry.path = dir.filePath(directories[d++]);
+          entry.directory = createNode(entry.path);
+          subdirectories.append(entry.directory);
+        }
+        entries.append(entry);
+      }
+      node->entries = entries;
+      node->done = true;
+    }
+    for (Node *subdirectory : subdirectories) {
+      submit(subdirectory);
+    }
+
+    if (!ok) {
+      emit error(errorMessage);
+    }
+    emit directoryListed(node->path, entries.size());
+    emit progress();
+  }
+
+  DirectoryScanner::Status DirectoryScanner::next(QFileInfo &file) {
+    QMutexLocker locker(&mutex);
+    while (!cursor.isEmpty()) {
+      QPair<Node*, int> &top = cursor.last();
+      Node *node = top.first;
+      if (!node->done) {
+        return Pending;
+      }
+      if (top.second >= node->entries.size()) {
+        // entries are not needed anymore
+        node->entries.clear();
+        cursor.removeLast();
+        continue;
+      }
+      const Entry &entry = node->entries[top.second++];
+      if (entry.directory != nullptr) {
+        cursor.append(qMakePair(entry.directory, 0));
+        continue;
+      }
+      file = QFileInfo(entry.path);
+      return Available;
+    }
+    return Finished;
+  }
+
+  bool DirectoryScanner::acceptFile(const char *name) const {
+    if (name[0] == '.') {
+      return false;
+    }
+    if (suffixes.isEmpty()) {
+      return true;
+    }
+    // complete suffix, everything after the first dot
+    const char *dot = std::strchr(name, '.');
+    if (dot == nullptr) {
+      return false;
+    }
+    const char *suffix = dot + 1;
+    size_t length = std::strlen(suffix);
+    for (const QByteArray &expected : suffixes) {
+      if ((size_t) expected.size() != length) {
+        continue;
+      }
+      bool match = true;
+      for (size_t i = 0; i < length && match; i++) {
+        char c = suffix[i];
+        if (c >= 'A' && c <= 'Z') {
+          c = c - 'A' + 'a';
+        }
+        match = c == expected[i];
+      }
+      if (match) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool DirectoryScanner::list(const QString &path, QStringList &files, QStringList &directories,
+    QString &errorMessage) const {
+
+#ifdef __linux__
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+      errorMessage = QString("Can't list directory %1: %2").arg(path).arg(std::strerror(errno));
+      return false;
+    }
+    std::unique_ptr<char[]> buffer(new char[DIRENT_BUFFER_SIZE]);
+    for (;;) {
+      long count = syscall(SYS_getdents64, fd, buffer.get(), DIRENT_BUFFER_SIZE);
+      if (count < 0) {
+        errorMessage = QString("Can't list directory %1: %2").arg(path).arg(std::strerror(errno));
+        ::close(fd);
+        return false;
+      }
+      if (count == 0) {
+        break;
+      }
+      for (long offset = 0; offset < count;) {
+        const LinuxDirent64 *entry = reinterpret_cast<const LinuxDirent64*>(buffer.get() + offset);
+        offset += entry->d_reclen;
+        const char *name = entry->d_name;
+        if (name[0] == '.') {
+          // hidden entries, "." and ".."
+          continue;
+        }
+        unsigned char type = entry->d_type;
+        if (type == DT_LNK || type == DT_UNKNOWN) {
+          // type of link target (or file system without d_type) requires stat
+          struct stat st;
+          if (fstatat(fd, name, &st, 0) != 0) {
+            continue;
+          }
+          type = S_ISREG(st.st_mode) ? DT_REG : (S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN);
+        }
+        if (type == DT_REG) {
+          if (acceptFile(name)) {
+            files.append(QFile::decodeName(name));
+          }
+        } else if (type == DT_DIR && recursive) {
+          directories.append(QFile::decodeName(name));
+        }
+      }
+    }
+    ::close(fd);
+#else
+    QDir dir(path);
+    if (!dir.exists()) {
+      errorMessage = QString("Can't list directory %1").arg(path);
+      return false;
+    }
+    QDir::Filters filters = recursive ? (QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot) : QDir::Files;
+    for (const QFileInfo &entry : dir.entryInfoList(filters, QDir::Unsorted)) {
+      if (entry.isDir()) {
+        directories.append(entry.fileName());
+      } else if (acceptFile(QFile::encodeName(entry.fileName()).constData())) {
+        files.append(entry.fileName());
+      }
+    }
+#endif
+
+    std::sort(files.begin(), files.end());
+    std::sort(directories.begin(), directories.end());
+    return true;
+  }
+
+}
@@ -0,0 +1,297 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/frame.h>
+
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace timelapse {
+
+  class FrameData : public QSharedData {
+  public:
+    FrameData(int width, int height, int channels, Frame::Layout layout) {
+      allocate(width, height, channels, layout);
+    }
+
+    FrameData(uint8_t *pixels, int width, int height, int stride, int channels, Frame::Layout layout,
+      Frame::Deleter deleter) :
+    pixels(pixels), deleter(deleter),
+    width(width), height(height), channels(channels), stride(stride), layout(layout) {
+    }
+
+    /**
+     * Deep copy, called when shared frame is detached.
+     */
+    FrameData(const FrameData &o) :
+    QSharedData(o) {
+      allocate(o.width, o.height, o.channels, o.layout);
+      size_t lineBytes = stride;
+      for (int p = 0; p < planeCount(); p++) {
+        for (int y = 0; y < height; y++) {
+          memcpy(line(y, p), o.line(y, p), lineBytes);
+        }
+      }
+    }
+
+    ~FrameData() {
+      if (deleter) {
+        deleter(pixels);
+      }
+    }
+
+    void allocate(int w, int h, int c, Frame::Layout l) {
+      if (w <= 0 || h <= 0) {
+        throw std::invalid_argument("Frame dimensions have to be positive");
+      }
+      if (c < 1 || c > 4) {
+        throw std::invalid_argument("Frame supports one to four channels");
+      }
+      width = w;
+      height = h;
+      channels = c;
+      layout = l;
+      stride = layout == Frame::Interleaved ? width * channels : width;
+      pixels = new uint8_t[planeCount() * (size_t) stride * height];
+      deleter = [](uint8_t *p) {
+        delete[] p;
+      };
+    }
+
+    int planeCount() const {
+      return layout == Frame::Interleaved ? 1 : channels;
+    }
+
+    uint8_t *line(int y, int plane) const {
+      return pixels + ((size_t) plane * height + y) * stride;
+    }
+
+    uint8_t *pixels{nullptr};
+    Frame::Deleter deleter;
+    int width{0};
+    int height{0};
+    int channels{0};
+    int stride{0};
+    Frame::Layout layout{Frame::Interleaved};
+  };
+
+  namespace {
+    std::string channelMap(int channels) {
+      switch (channels) {
+        case 1: return "I";
+        case 3: return "RGB";
+        case 4: return "RGBA";
+        default: throw std::invalid_argument("Unsupported count of channels");
+      }
+    }
+  }
+
+  Frame::Frame() {
+  }
+
+  Frame::Frame(int width, int height, int channels, Layout layout) :
+  d(new FrameData(width, height, channels, layout)) {
+  }
+
+  Frame::Frame(const Frame &other) = default;
+
+  Frame &Frame::operator=(const Frame &other) = default;
+
+  Frame::~Frame() = default;
+
+  Frame Frame::wrap(uint8_t *data, int width, int height, int stride, int channels, Layout layout,
+    Deleter deleter) {
+
+    int minStride = layout == Interleaved ? width * channels : width;
+    if (stride < minStride) {
+      throw std::invalid_argument("Frame stride is smaller than line");
+    }
+    Frame f;
+    f.d = new FrameData(data, width, height, stride, channels, layout, deleter);
+    return f;
+  }
+
+  Frame Frame::fromImage(const Magick::Image &image) {
+    Frame f(image.columns(), image.rows(), 3, Interleaved);
+    // Magick++ write method is not const, but it doesn't modify pixels
+    Magick::Image img = image;
+    img.write(0, 0, f.width(), f.height(), "RGB", Magick::CharPixel, f.data());
+    return f;
+  }
+
+  Magick::Image Frame::toImage() const {
+    if (isNull()) {
+      return Magick::Image();
+    }
+    Frame f = converted(Interleaved);
+    if (f.stride() != f.width() * f.channels()) {
+      // Magick requires continuous buffer
+      Frame compact(f.width(), f.height(), f.channels(), Interleaved);
+      for (int y = 0; y < f.height(); y++) {
+        memcpy(compact.line(y), f.constLine(y), compact.stride());
+      }
+      f = compact;
+    }
+    Magick::Image image(f.width(), f.height(), channelMap(f.channels()), Magick::CharPixel, f.constData());
+    image.depth(8);
+    return image;
+  }
+
+  Frame Frame::converted(Layout layout) const {
+    if (isNull() || layout == d->layout) {
+      return *this;
+    }
+    Frame f(width(), height(), channels(), layout);
+    int c = channels();
+    for (int y = 0; y < height(); y++) {
+      if (layout == Planar) {
+        const uint8_t *src = constLine(y);
+        for (int p = 0; p < c; p++) {
+          uint8_t *dst = f.line(y, p);
+          for (int x = 0; x < width(); x++) {
+            dst[x] = src[x * c + p];
+          }
+        }
+      } else {
+        uint8_t *dst = f.line(y);
+        for (int p = 0; p < c; p++) {
+          const uint8_t *src = constLine(y, p);
+          for (int x = 0; x < width(); x++) {
+            dst[x * c + p] = src[x];
+          }
+        }
+      }
+    }
+    return f;
+  }
+
+  bool Frame::isNull() const {
+    return !d;
+  }
+
+  int Frame::width() const {
+    return d ? d->width : 0;
+  }
+
+  int Frame::height() const {
+    return d ? d->height : 0;
+  }
+
+  int Frame::channels() const {
+    return d ? d->channels : 0;
+  }
+
+  Frame::Layout Frame::layout() const {
+    return d ? d->layout : Interleaved;
+  }
+
+  int Frame::stride() const {
+    return d ? d->stride : 0;
+  }
+
+  int64_t Frame::byteSize() const {
+    return d ? (int64_t) d->planeCount() * d->stride * d->height : 0;
+  }
+
+  const uint8_t *Frame::constData() const {
+    return d ? d->pixels : nullptr;
+  }
+
+  const uint8_t *Frame::constLine(int y, int plane) const {
+    return d->line(y, plane);
+  }
+
+  uint8_t *Frame::data() {
+    return d ? d->pixels : nullptr;
+  }
+
+  uint8_t *Frame::line(int y, int plane) {
+    return d->line(y, plane);
+  }
+
+  class FramePool::State {
+  public:
+    explicit State(int capacity) : capacity(capacity) {}
+
+    ~State() {
+      for (uint8_t *buffer : buffers) {
+        delete[] buffer;
+      }
+    }
+
+    QMutex mutex;
+    int capacity;
+    size_t bufferSize{0};
+    std::vector<uint8_t*> buffers;
+  };
+
+  FramePool::FramePool(int capacity) :
+  state(std::make_shared<State>(capacity)) {
+    if (capacity < 0) {
+      throw std::invalid_argument("Frame pool capacity can't be negative");
+    }
+  }
+
+  Frame FramePool::acquire(int width, int height, int channels, Frame::Layout layout) {
+    if (width <= 0 || height <= 0) {
+      throw std::invalid_argument("Frame dimensions have to be positive");
+    }
+    if (channels < 1 || channels > 4) {
+      throw std::invalid_argument("Frame supports one to four channels");
+    }
+    int stride = layout == Frame::Interleaved ? width * channels : width;
+    size_t size = (size_t) width * height * channels;
+
+    uint8_t *buffer = nullptr;
+    {
+      QMutexLocker locker(&state->mutex);
+      if (state->bufferSize != size) {
+        // geometry changed, recycled buffers are useless
+        for (uint8_t *b : state->buffers) {
+          delete[] b;
+        }
+        state->buffers.clear();
+        state->bufferSize = size;
+      }
+      if (!state->buffers.empty()) {
+        buffer = state->buffers.back();
+        state->buffers.pop_back();
+      }
+    }
+    if (buffer == nullptr) {
+      buffer = new uint8_t[size];
+    }
+
+    // buffer holds the pool state, it may outlive the pool
+    std::shared_ptr<State> s = state;
+    return Frame::wrap(buffer, width, height, stride, channels, layout, [s, size](uint8_t *p) {
+      QMutexLocker locker(&s->mutex);
+      if (s->bufferSize == size && (int) s->buffers.size() < s->capacity) {
+        s->buffers.push_back(p);
+      } else {
+        delete[] p;
+      }
+    });
+  }
+
+}
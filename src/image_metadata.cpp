@@ -0,0 +1,334 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/image_metadata.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+
+#include <Magick++.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace timelapse {
+
+  namespace {
+
+    constexpr uint16_t TAG_IMAGE_WIDTH = 0x0100;
+    constexpr uint16_t TAG_IMAGE_LENGTH = 0x0101;
+    constexpr uint16_t TAG_DATE_TIME = 0x0132;
+    constexpr uint16_t TAG_SUB_IFDS = 0x014A;
+    constexpr uint16_t TAG_EXIF_IFD = 0x8769;
+    constexpr uint16_t TAG_DATE_TIME_ORIGINAL = 0x9003;
+    constexpr uint16_t TAG_PIXEL_X_DIMENSION = 0xA002;
+    constexpr uint16_t TAG_PIXEL_Y_DIMENSION = 0xA003;
+
+    constexpr uint16_t TYPE_ASCII = 2;
+    constexpr uint16_t TYPE_SHORT = 3;
+    constexpr uint16_t TYPE_LONG = 4;
+    constexpr uint16_t TYPE_IFD = 13;
+
+    /* limit of IFDs visited in one file, it protects against loops */
+    constexpr int MAX_IFDS = 32;
+
+    /**
+     * Bounds checked reader of TIFF structure (TIFF file or EXIF block of JPEG).
+     */
+    class TiffParser {
+    public:
+      TiffParser(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+      bool parse(ImageMetadata &metadata) {
+        if (size < 8) {
+          return false;
+        }
+        if (data[0] == 'I' && data[1] == 'I') {
+          littleEndian = true;
+        } else if (data[0] == 'M' && data[1] == 'M') {
+          littleEndian = false;
+        } else {
+          return false;
+        }
+        uint16_t magic = u16(2);
+        // 42 for TIFF, Olympus ORF and Panasonic RW2 use their own values
+        if (magic != 42 && magic != 0x4F52 && magic != 0x5352 && magic != 0x55) {
+          return false;
+        }
+
+        // IFD0 chain, dimensions of the biggest image are used (RAW files starts with thumbnail often)
+        uint32_t offset = u32(4);
+        int visited = 0;
+        while (offset != 0 && visited++ < MAX_IFDS) {
+          offset = parseIfd(offset, true);
+        }
+        for (int i = 0; i < subIfds.size() && visited++ < MAX_IFDS; i++) {
+          parseIfd(subIfds[i], false);
+        }
+        if (exifIfd != 0) {
+          parseIfd(exifIfd, false);
+        }
+
+        if (width > 0 && height > 0) {
+          metadata.width = width;
+          metadata.height = height;
+        } else if (pixelX > 0 && pixelY > 0) {
+          metadata.width = pixelX;
+          metadata.height = pixelY;
+        }
+        metadata.exifDateTime = !dateTime.isEmpty() ? dateTime : dateTimeOriginal;
+        return true;
+      }
+
+    private:
+      bool inside(size_t offset, size_t length) const {
+        return offset <= size && length <= size - offset;
+      }
+
+      uint16_t u16(size_t offset) const {
+        if (!inside(offset, 2)) {
+          return 0;
+        }
+        const uint8_t *p = data + offset;
+        return littleEndian ? (p[0] | (p[1] << 8)) : ((p[0] << 8) | p[1]);
+      }
+
+      uint32_t u32(size_t offset) const {
+        if (!inside(offset, 4)) {
+          return 0;
+        }
+        const uint8_t *p = data + offset;
+        return littleEndian ?
+          (uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24)) :
+          ((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]));
+      }
+
+      uint32_t value(uint16_t type, size_t entry) const {
+        return type == TYPE_SHORT ? u16(entry + 8) : u32(entry + 8);
+      }
+
+      QString ascii(uint32_t count, size_t entry) const {
+        size_t offset = count <= 4 ? entry + 8 : u32(entry + 8);
+        if (count == 0 || !inside(offset, count)) {
+          return QString();
+        }
+        const char *str = reinterpret_cast<const char*>(data + offset);
+        return QString::fromLatin1(str, strnlen(str, count)).trimmed();
+      }
+
+      /**
+       * @return offset of the next IFD in chain
+       */
+      uint32_t parseIfd(uint32_t offset, bool mainChain) {
+        if (!inside(offset, 2)) {
+          return 0;
+        }
+        uint16_t count = u16(offset);
+        if (!inside(offset + 2, size_t(count) * 12 + 4)) {
+          return 0;
+        }
+        uint32_t ifdWidth = 0;
+        uint32_t ifdHeight = 0;
+        for (uint16_t i = 0; i < count; i++) {
+          size_t entry = offset + 2 + size_t(i) * 12;
+          uint16_t tag = u16(entry);
+          uint16_t type = u16(entry + 2);
+          uint32_t n = u32(entry + 4);
+          bool integer = type == TYPE_SHORT || type == TYPE_LONG || type == TYPE_IFD;
+          switch (tag) {
+            case TAG_IMAGE_WIDTH:
+              if (integer) ifdWidth = value(type, entry);
+              break;
+            case TAG_IMAGE_LENGTH:
+              if (integer) ifdHeight = value(type, entry);
+              break;
+            case TAG_DATE_TIME:
+              if (type == TYPE_ASCII && mainChain && dateTime.isEmpty()) dateTime = ascii(n, entry);
+              break;
+            case TAG_DATE_TIME_ORIGINAL:
+              if (type == TYPE_ASCII) dateTimeOriginal = ascii(n, entry);
+              break;
+            case TAG_PIXEL_X_DIMENSION:
+              if (integer) pixelX = value(type, entry);
+              break;
+            case TAG_PIXEL_Y_DIMENSION:
+              if (integer) pixelY = value(type, entry);
+              break;
+            case TAG_EXIF_IFD:
+              if (integer) exifIfd = value(type, entry);
+              break;
+            case TAG_SUB_IFDS:
+              if (integer) {
+                if (n == 1) {
+                  subIfds.append(value(type, entry));
+                } else if (type != TYPE_SHORT) {
+                  uint32_t array = u32(entry + 8);
+                  for (uint32_t j = 0; j < n && j < MAX_IFDS && inside(array + j * 4, 4); j++) {
+                    subIfds.append(u32(array + j * 4));
+                  }
+                }
+              }
+              break;
+            default:
+              break;
+          }
+        }
+        if (uint64_t(ifdWidth) * ifdHeight > uint64_t(width) * height) {
+          width = ifdWidth;
+          height = ifdHeight;
+        }
+        return u32(offset + 2 + size_t(count) * 12);
+      }
+
+    private:
+      const uint8_t *data;
+      size_t size;
+      bool littleEndian{true};
+
+      uint32_t width{0};
+      uint32_t height{0};
+      uint32_t pixelX{0};
+      uint32_t pixelY{0};
+      uint32_t exifIfd{0};
+      QList<uint32_t> subIfds;
+      QString dateTime;
+      QString dateTimeOriginal;
+    };
+
+    bool isSof(uint8_t marker) {
+      // SOF0..SOF15 without DHT (C4), JPG (C8) and DAC (CC)
+      return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+    }
+
+    bool parseJpeg(QFile &file, ImageMetadata &metadata) {
+      uint8_t soi[2];
+      if (file.read(reinterpret_cast<char*>(soi), 2) != 2 || soi[0] != 0xFF || soi[1] != 0xD8) {
+        return false;
+      }
+      bool exif = false;
+      for (;;) {
+        uint8_t marker[4];
+        if (file.read(reinterpret_cast<char*>(marker), 4) != 4 || marker[0] != 0xFF) {
+          return false;
+        }
+        while (marker[1] == 0xFF) {
+          // fill bytes before marker
+          marker[1] = marker[2];
+          marker[2] = marker[3];
+          if (file.read(reinterpret_cast<char*>(marker + 3), 1) != 1) {
+            return false;
+          }
+        }
+        uint16_t length = (marker[2] << 8) | marker[3];
+        if (length < 2) {
+          return false;
+        }
+        qint64 payload = length - 2;
+        if (marker[1] == 0xE1 && !exif) {
+          QByteArray segment = file.read(payload);
+          if (segment.size() != payload) {
+            return false;
+          }
+          if (segment.size() > 6 && std::memcmp(segment.constData(), "Exif\0\0", 6) == 0) {
+            exif = true;
+            ImageMetadata exifMetadata;
+            TiffParser parser(reinterpret_cast<const uint8_t*>(segment.constData()) + 6, segment.size() - 6);
+            if (parser.parse(exifMetadata)) {
+              metadata.exifDateTime = exifMetadata.exifDateTime;
+            }
+          }
+        } else if (isSof(marker[1])) {
+          uint8_t sof[5];
+          if (payload < 5 || file.read(reinterpret_cast<char*>(sof), 5) != 5) {
+            return false;
+          }
+          // dimensions of JPEG frame are authoritative, EXIF block precedes frame header
+          metadata.height = (sof[1] << 8) | sof[2];
+          metadata.width = (sof[3] << 8) | sof[4];
+          return true;
+        } else if (marker[1] == 0xDA || marker[1] == 0xD9) {
+          // start of scan or end of image without frame header
+          return false;
+        } else if (!file.seek(file.pos() + payload)) {
+          return false;
+        }
+      }
+    }
+
+    bool parseTiff(QFile &file, ImageMetadata &metadata) {
+      // IFDs may be anywhere in the file, mapping reads just touched pages
+      qint64 size = file.size();
+      uchar *data = file.map(0, size);
+      if (data == nullptr) {
+        return false;
+      }
+      TiffParser parser(data, size);
+      bool result = parser.parse(metadata);
+      file.unmap(data);
+      return result;
+    }
+  }
+
+  QDateTime ImageMetadata::timestamp() const {
+    if (exifDateTime.isEmpty()) {
+      return QDateTime();
+    }
+    // 2015:09:15 07:00:28
+    return QDateTime::fromString(exifDateTime, QString("yyyy:MM:dd HH:mm:ss"));
+  }
+
+  bool ImageMetadataParser::parseHeaders(const QString &path, ImageMetadata &metadata) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+      return false;
+    }
+    char magic[4];
+    if (file.read(magic, 4) != 4 || !file.seek(0)) {
+      return false;
+    }
+    if (uint8_t(magic[0]) == 0xFF && uint8_t(magic[1]) == 0xD8) {
+      return parseJpeg(file, metadata);
+    }
+    if ((magic[0] == 'I' && magic[1] == 'I') || (magic[0] == 'M' && magic[1] == 'M')) {
+      return parseTiff(file, metadata);
+    }
+    return false;
+  }
+
+  bool ImageMetadataParser::read(const QString &path, ImageMetadata &metadata, QString &error) {
+    if (parseHeaders(path, metadata)) {
+      return true;
+    }
+    metadata = ImageMetadata();
+    try {
+      Magick::Image image;
+      image.ping(path.toStdString());
+      metadata.width = image.columns();
+      metadata.height = image.rows();
+      metadata.exifDateTime = QString::fromStdString(image.attribute("EXIF:DateTime"));
+    } catch (Magick::Exception &e) {
+      error = QString::fromUtf8(e.what());
+      return false;
+    }
+    return true;
+  }
+
+}
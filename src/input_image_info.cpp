@@ -20,8 +20,8 @@
 #include <TimeLapse/input_image_info.h>
 
 InputImageInfo::InputImageInfo(const QFileInfo &f) :
-filePath(f.absoluteFilePath().toStdString()), width(-1), height(-1), frame(-1), timestamp(),
-luminance(-1), luminanceChange(0) {
+filePath(f.absoluteFilePath().toStdString()), width(-1), height(-1), frame(-1), repeat(1), timestamp(),
+luminance(-1), luminanceChange(0), credit(-1) {
 }
 
 QFileInfo InputImageInfo::fileInfo() const {
@@ -21,7 +21,16 @@
 #include <TimeLapse/pipeline.h>
 #include <TimeLapse/pipeline_handler.h>
 #include <TimeLapse/pipeline_cpt.h>
+#include <TimeLapse/pipeline_watch_source.h>
+#include <TimeLapse/queued_output_device.h>
+#include <TimeLapse/pipeline_frame_cache.h>
+#include <TimeLapse/pipeline_deflicker.h>
 
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+
+#include <algorithm>
 #include <exception>
 
 namespace timelapse {
@@ -40,6 +49,15 @@ namespace timelapse {
     return new Pipeline(src, src, verboseOutput, err);
   }
 
+  Pipeline* Pipeline::createWithWatchSource(const QString &directory, const QStringList &fileSuffixes,
+    int64_t quiescenceMs, const QString &sentinel, QTextStream *verboseOutput, QTextStream *err) {
+
+    PipelineWatchSource *src = new PipelineWatchSource(directory, fileSuffixes, quiescenceMs, sentinel, verboseOutput, err);
+    Pipeline *pipeline = new Pipeline(src, src, verboseOutput, err);
+    pipeline->skipUndecodable = true;
+    return pipeline;
+  }
+
   Pipeline::Pipeline(PipelineSource *src, InputHandler *firstInputHandler,
     QTextStream *verboseOutput, QTextStream *err) :
   verboseOutput(verboseOutput), err(err),
@@ -57,9 +75,307 @@ namespace timelapse {
   }
 
   Pipeline::~Pipeline() {
+    for (QThread *thread : threads) {
+      thread->quit();
+    }
+    // unblock stages waiting for space in full queue
+    for (QSemaphore *queue : queues) {
+      queue->release(queueCapacity);
+    }
+    if (flowControl != nullptr) {
+      flowControl->close();
+    }
+    for (QThread *thread : threads) {
+      thread->wait();
+      delete thread;
+    }
     for (QObject *el : elements) {
       delete el;
     }
+    for (QObject *el : fusedHandlers) {
+      delete el;
+    }
+    for (QSemaphore *queue : queues) {
+      delete queue;
+    }
+    for (CreditTracker *tracker : creditTrackers) {
+      delete tracker;
+    }
+    for (StageStats *s : stageStatsList) {
+      delete s;
+    }
+    delete trace;
+    for (PipelineBranch *branch : branches) {
+      delete branch;
+    }
+    for (QTextStream *stream : stageStreams) {
+      stream->flush();
+      delete stream;
+    }
+  }
+
+  void Pipeline::setThreaded(int _queueCapacity) {
+    if (elements.size() > 1) {
+      throw logic_error("Threaded mode has to be configured before appending handlers");
+    }
+    if (_queueCapacity < 1) {
+      throw invalid_argument("Queue capacity have to be positive!");
+    }
+    threaded = true;
+    queueCapacity = _queueCapacity;
+  }
+
+  bool Pipeline::isThreaded() const {
+    return threaded;
+  }
+
+  void Pipeline::setFlowControl(int maxFrames, int64_t maxBytes) {
+    if (!threaded) {
+      throw logic_error("Flow control requires threaded pipeline");
+    }
+    if (elements.size() > 1) {
+      throw logic_error("Flow control has to be configured before appending handlers");
+    }
+    flowControl = new FlowControl(maxFrames, maxBytes);
+    flowControl->setParent(this);
+    src->setFlowControl(flowControl);
+  }
+
+  StageStats* Pipeline::stageStats(PipelineHandler *handler) {
+    auto it = stageStatsMap.find(handler);
+    if (it != stageStatsMap.end()) {
+      return it.value();
+    }
+    QString name = handler->objectName().isEmpty() ? QString(handler->metaObject()->className()) : handler->objectName();
+    StageStats *s = new StageStats(name);
+    stageStatsList.append(s);
+    stageStatsMap.insert(handler, s);
+    if (ImageHandlerPool *pool = qobject_cast<ImageHandlerPool*>(handler)) {
+      // busy time is measured in workers
+      pool->setStats(s);
+    }
+    return s;
+  }
+
+  QJsonDocument Pipeline::stats() const {
+    QJsonArray stages;
+    for (StageStats *s : stageStatsList) {
+      stages.append(s->toJson());
+    }
+    QJsonObject root;
+    root["threaded"] = threaded;
+    root["workers"] = workerCount;
+    root["wall_ms"] = wallTimer.isValid() ? (double) wallTimer.elapsed() : 0.0;
+    root["stages"] = stages;
+    return QJsonDocument(root);
+  }
+
+  bool Pipeline::writeStats(const QString &file) const {
+    QFile f(file);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      *err << "Can't open stats file " << file << ": " << f.errorString() << endl;
+      return false;
+    }
+    QByteArray json = stats().toJson(QJsonDocument::Indented);
+    if (f.write(json) != json.size()) {
+      *err << "Failed to write stats file " << file << ": " << f.errorString() << endl;
+      return false;
+    }
+    return true;
+  }
+
+  void Pipeline::enableTrace() {
+    if (trace != nullptr) {
+      return;
+    }
+    trace = new TraceRecorder();
+    // loaders of the pool count their images separately, count them for whole stage
+    connect(this, &Pipeline::imageLoaded, this, [this](int stage, [[maybe_unused]] int cnt) {
+      trace->counter("images loaded", QString("stage %1").arg(stage), ++loadedImages[stage]);
+    });
+  }
+
+  bool Pipeline::writeTrace(const QString &file) const {
+    if (trace == nullptr) {
+      throw logic_error("Trace is not enabled");
+    }
+    QString errorString;
+    if (!trace->write(file, &errorString)) {
+      *err << "Failed to write trace file " << file << ": " << errorString << endl;
+      return false;
+    }
+    return true;
+  }
+
+  void Pipeline::connectLast(PipelineHandler *from, PipelineHandler *to) {
+    QString name = QString("%1 last").arg(stageStats(to)->name());
+    connect(from, &PipelineHandler::last, to, [this, to, name]() {
+      // end of stream processing may be long (StageSeparator, video encoding...)
+      TraceSpan span(trace, name);
+      to->onLast();
+    });
+  }
+
+  CreditTracker* Pipeline::creditTracker(PipelineHandler *handler) {
+    ImageHandler *imageHandler = qobject_cast<ImageHandler*>(handler);
+    if (flowControl == nullptr || imageHandler == nullptr) {
+      return nullptr;
+    }
+    CreditTracker *tracker = new CreditTracker(flowControl);
+    creditTrackers.append(tracker);
+    connect(imageHandler, &ImageHandler::inputImg, imageHandler,
+      [tracker](InputImageInfo info, [[maybe_unused]] Frame frame) {
+        tracker->onOutput(info.credit);
+      }, Qt::DirectConnection);
+    connect(imageHandler, &PipelineHandler::last, imageHandler, [tracker]() {
+      tracker->onLast();
+    }, Qt::DirectConnection);
+    return tracker;
+  }
+
+  void Pipeline::admit(CreditTracker *tracker, InputImageInfo &info) {
+    if (flowControl == nullptr) {
+      return;
+    }
+    if (tracker != nullptr) {
+      tracker->onInput(info.credit);
+    } else {
+      // handler without image, frame don't hold decoded data anymore
+      flowControl->release(info.credit);
+      info.credit = -1;
+    }
+  }
+
+  QTextStream* Pipeline::stageStream(QTextStream *target) {
+    if (!threaded) {
+      return target;
+    }
+    QueuedOutputDevice *device = new QueuedOutputDevice(target, this);
+    device->setParent(this);
+    QTextStream *stream = new QTextStream(device);
+    stageStreams.append(stream);
+    return stream;
+  }
+
+  QTextStream* Pipeline::stageVerboseOutput() {
+    return stageStream(verboseOutput);
+  }
+
+  QTextStream* Pipeline::stageErr() {
+    return stageStream(err);
+  }
+
+  void Pipeline::setWorkers(int workers) {
+    if (workers < 1) {
+      throw invalid_argument("Worker count have to be positive!");
+    }
+    workerCount = workers;
+  }
+
+  int Pipeline::workers() const {
+    return workerCount;
+  }
+
+  void Pipeline::setFastAnalysis(bool fast) {
+    fastAnalysis = fast;
+  }
+
+  void Pipeline::setFrameCache(QSharedPointer<DecodedFrameCache> cache) {
+    if (elements.size() > 1) {
+      throw logic_error("Frame cache has to be configured before appending handlers");
+    }
+    frameCache = cache;
+  }
+
+  void Pipeline::setSequenceIndex(QSharedPointer<SequenceIndex> index) {
+    if (elements.size() > 1) {
+      throw logic_error("Sequence index has to be configured before appending handlers");
+    }
+    sequenceIndex = index;
+    src->setSequenceIndex(sequenceIndex.data());
+  }
+
+  void Pipeline::setReadAhead(int count) {
+    if (elements.size() > 1) {
+      throw logic_error("Read-ahead has to be configured before appending handlers");
+    }
+    if (count < 0) {
+      throw invalid_argument("Read-ahead count can't be negative!");
+    }
+    readAhead = count;
+  }
+
+  ImageHandler* Pipeline::parallel(ImageHandlerFactory factory) {
+    if (workerCount <= 1) {
+      return factory(stageVerboseOutput(), stageErr());
+    }
+    return new ImageHandlerPool(workerCount, factory, stageVerboseOutput(), stageErr());
+  }
+
+  template<typename Receiver>
+  void Pipeline::connectInput(InputHandler *from, Receiver *to, void (Receiver::*slot)(InputImageInfo)) {
+    StageStats *stats = stageStats(to);
+    // pool measures busy time in its workers
+    StageStats *busyStats = qobject_cast<ImageHandlerPool*>(to) == nullptr ? stats : nullptr;
+    if (!threaded) {
+      connect(from, &InputHandler::input, to, [this, to, slot, stats, busyStats](InputImageInfo info) {
+        stats->onInput(0, 0);
+        TraceSpan span(trace, stats->name(), &info);
+        StageTimer timer(busyStats);
+        (to->*slot)(info);
+      });
+      return;
+    }
+    QSemaphore *queue = new QSemaphore(queueCapacity);
+    queues.append(queue);
+    CreditTracker *tracker = creditTracker(to);
+    // acquire queue slot in the sender thread, process the input in the receiver thread
+    connect(from, &InputHandler::input, to, [this, queue, to, slot, tracker, stats, busyStats](InputImageInfo info) {
+      queue->acquire();
+      int64_t enqueued = StageTimer::now();
+      QMetaObject::invokeMethod(to, [this, queue, to, slot, tracker, stats, busyStats, info, enqueued]() mutable {
+        stats->onInput(StageTimer::now() - enqueued, 0);
+        admit(tracker, info);
+        {
+          TraceSpan span(trace, stats->name(), &info);
+          StageTimer timer(busyStats);
+          (to->*slot)(info);
+        }
+        queue->release();
+      }, Qt::QueuedConnection);
+    }, Qt::DirectConnection);
+  }
+
+  template<typename Receiver>
+  void Pipeline::connectImage(ImageHandler *from, Receiver *to, void (Receiver::*slot)(InputImageInfo, Frame)) {
+    StageStats *stats = stageStats(to);
+    StageStats *busyStats = qobject_cast<ImageHandlerPool*>(to) == nullptr ? stats : nullptr;
+    if (!threaded) {
+      connect(from, &ImageHandler::inputImg, to, [this, to, slot, stats, busyStats](InputImageInfo info, Frame frame) {
+        stats->onInput(0, frame.byteSize());
+        TraceSpan span(trace, stats->name(), &info);
+        StageTimer timer(busyStats);
+        (to->*slot)(info, frame);
+      });
+      return;
+    }
+    QSemaphore *queue = new QSemaphore(queueCapacity);
+    queues.append(queue);
+    CreditTracker *tracker = creditTracker(to);
+    connect(from, &ImageHandler::inputImg, to, [this, queue, to, slot, tracker, stats, busyStats](InputImageInfo info, Frame frame) {
+      queue->acquire();
+      int64_t enqueued = StageTimer::now();
+      QMetaObject::invokeMethod(to, [this, queue, to, slot, tracker, stats, busyStats, info, frame, enqueued]() mutable {
+        stats->onInput(StageTimer::now() - enqueued, frame.byteSize());
+        admit(tracker, info);
+        {
+          TraceSpan span(trace, stats->name(), &info);
+          StageTimer timer(busyStats);
+          (to->*slot)(info, frame);
+        }
+        queue->release();
+      }, Qt::QueuedConnection);
+    }, Qt::DirectConnection);
   }
 
   void Pipeline::handlerFinished() {
@@ -85,43 +401,172 @@ namespace timelapse {
     connect(handler, &PipelineHandler::last, this, &Pipeline::handlerFinished);
     connect(handler, &PipelineHandler::error, this, &Pipeline::onError);
     connect(handler, &PipelineHandler::error, this, &Pipeline::error);
+    StageStats *stats = stageStats(handler);
+    if (ImageHandler *imageHandler = qobject_cast<ImageHandler*>(handler)) {
+      connect(imageHandler, &ImageHandler::inputImg, imageHandler, [stats]() {
+        stats->onOutput();
+      }, Qt::DirectConnection);
+    } else if (InputHandler *inputHandler = qobject_cast<InputHandler*>(handler)) {
+      connect(inputHandler, &InputHandler::input, inputHandler, [stats]() {
+        stats->onOutput();
+      }, Qt::DirectConnection);
+    }
+    if (FrameCacheSeparator *cache = qobject_cast<FrameCacheSeparator*>(handler)) {
+      cache->setFlowControl(flowControl);
+    }
+    if (!sequenceIndex.isNull()) {
+      auto useIndex = [this](ImageHandler *h) {
+        if (ComputeLuminance *luminance = qobject_cast<ComputeLuminance*>(h)) {
+          luminance->setSequenceIndex(sequenceIndex.data());
+        }
+      };
+      if (ImageHandlerPool *pool = qobject_cast<ImageHandlerPool*>(handler)) {
+        pool->forEachHandler(useIndex);
+      } else if (ImageHandler *imageHandler = qobject_cast<ImageHandler*>(handler)) {
+        useIndex(imageHandler);
+      } else if (ImageMetadataReader *metadata = qobject_cast<ImageMetadataReader*>(handler)) {
+        metadata->setSequenceIndex(sequenceIndex.data());
+      }
+    }
+    if (threaded && !elements.isEmpty()) {
+      // source stays in the main thread
+      QThread *thread = new QThread();
+      thread->setObjectName(handler->metaObject()->className());
+      handler->moveToThread(thread);
+      threads.append(thread);
+    }
     elements.append(handler);
   }
 
-  void Pipeline::operator<<(ImageHandler *handler) {
+  void Pipeline::chain(InputHandler *&lastInputHandler, ImageHandler *&lastImageHandler, ImageHandler *handler) {
 
     if (lastInputHandler != nullptr) {
-      ImageLoader *loader = new ImageLoader(verboseOutput, err, stage++);
-      connect(lastInputHandler, &InputHandler::input, loader, &ImageLoader::onInput);
-      connect(lastInputHandler, &InputHandler::last, loader, &ImageLoader::onLast);
-      connect(loader, &ImageLoader::onImageLoaded, this, &Pipeline::imageLoaded);
+      int loaderStage = stage++;
+      ImageHandler *loader;
+      if (workerCount > 1) {
+        ImageHandlerPool *pool = new ImageHandlerPool(workerCount,
+          [this, loaderStage](QTextStream *verboseOutput, QTextStream *err) {
+            ImageLoader *loader = new ImageLoader(verboseOutput, err, loaderStage);
+            loader->setFlowControl(flowControl);
+            loader->setFrameCache(frameCache);
+            loader->setSkipUndecodable(skipUndecodable);
+            connect(loader, &ImageLoader::onImageLoaded, this, &Pipeline::imageLoaded);
+            return loader;
+          },
+          stageVerboseOutput(), stageErr());
+        connectInput(lastInputHandler, pool, &ImageHandlerPool::onInput);
+        loader = pool;
+      } else {
+        ImageLoader *singleLoader = new ImageLoader(stageVerboseOutput(), stageErr(), loaderStage);
+        singleLoader->setFlowControl(flowControl);
+        singleLoader->setReadAhead(readAhead);
+        singleLoader->setFrameCache(frameCache);
+        singleLoader->setSkipUndecodable(skipUndecodable);
+        connectInput(lastInputHandler, singleLoader, &ImageLoader::onInput);
+        connect(singleLoader, &ImageLoader::onImageLoaded, this, &Pipeline::imageLoaded);
+        loader = singleLoader;
+      }
+      connectLast(lastInputHandler, loader);
+      downstream[lastInputHandler].append(loader);
+      loaders.append(loader);
       append(loader);
 
       lastInputHandler = nullptr;
       lastImageHandler = loader;
     }
 
+    if (lastImageHandler != nullptr &&
+      downstream.value(lastImageHandler).isEmpty() &&
+      !forkPoints.contains(lastImageHandler) &&
+      fuse(lastImageHandler, handler)) {
+
+      return;
+    }
+
     if (lastImageHandler != nullptr) {
 
-      connect(lastImageHandler, &ImageHandler::inputImg, handler, &ImageHandler::onInputImg);
-      connect(lastImageHandler, &InputHandler::last, handler, &ImageHandler::onLast);
+      connectImage(lastImageHandler, handler, &ImageHandler::onInputImg);
+      connectLast(lastImageHandler, handler);
       //*verboseOutput << "Connect " << lastImageHandler->metaObject()->className()
       //  << " to " << handler->metaObject()->className() << endl;
 
     } else {
       throw runtime_error("Weird pipeline state");
     }
+    downstream[lastImageHandler].append(handler);
     lastInputHandler = nullptr;
     lastImageHandler = handler;
 
     append(handler);
   }
 
-  void Pipeline::operator<<(InputHandler *handler) {
+  bool Pipeline::fuse(ImageHandler *previous, ImageHandler *handler) {
+    // fused stage would claim wrong scale invariance otherwise
+    if (previous->scaleInvariant() != handler->scaleInvariant()) {
+      return false;
+    }
+    QList<PixelMapHandler*> previousMaps;
+    QList<PixelMapHandler*> handlerMaps;
+    ImageHandlerPool *previousPool = qobject_cast<ImageHandlerPool*>(previous);
+    ImageHandlerPool *handlerPool = qobject_cast<ImageHandlerPool*>(handler);
+    if (previousPool != nullptr && handlerPool != nullptr) {
+      // workers of the pools are paired, both pools have to be created with the same worker count
+      auto collect = [](QList<PixelMapHandler*> &maps) {
+        return [&maps](ImageHandler *h) {
+          maps.append(qobject_cast<PixelMapHandler*>(h));
+        };
+      };
+      previousPool->forEachHandler(collect(previousMaps));
+      handlerPool->forEachHandler(collect(handlerMaps));
+      if (previousMaps.size() != handlerMaps.size()) {
+        return false;
+      }
+    } else if (previousPool == nullptr && handlerPool == nullptr) {
+      previousMaps.append(qobject_cast<PixelMapHandler*>(previous));
+      handlerMaps.append(qobject_cast<PixelMapHandler*>(handler));
+    } else {
+      return false;
+    }
+    if (previousMaps.contains(nullptr) || handlerMaps.contains(nullptr)) {
+      return false;
+    }
+    for (int i = 0; i < previousMaps.size(); i++) {
+      previousMaps[i]->fuse(handlerMaps[i]);
+    }
+    // fused handlers are called from the thread of their host, threads of absorbed pool are not needed anymore
+    if (handlerPool != nullptr) {
+      QList<QThread*> targets;
+      for (PixelMapHandler *host : previousMaps) {
+        targets.append(host->thread());
+      }
+      handlerPool->stopWorkers(targets);
+    } else {
+      handler->moveToThread(previous->thread());
+    }
+    // time of fused stages is reported (stats, trace) under the name of the combined stage
+    QString name = previousMaps.first()->fusedName();
+    if (previousPool != nullptr) {
+      name = QString("%1 x%2").arg(name).arg(previousMaps.size());
+    }
+    *verboseOutput << "Pipeline fuse " << handler->metaObject()->className()
+      << " to " << previous->metaObject()->className() << ", stage " << name << endl;
+    previous->setObjectName(name);
+    stageStats(previous)->setName(name);
+    if (threaded) {
+      previous->thread()->setObjectName(name);
+    }
+    connect(handler, &PipelineHandler::error, this, &Pipeline::onError);
+    connect(handler, &PipelineHandler::error, this, &Pipeline::error);
+    fusedHandlers.append(handler);
+    return true;
+  }
+
+  void Pipeline::chain(InputHandler *&lastInputHandler, ImageHandler *&lastImageHandler, InputHandler *handler) {
     if (lastImageHandler != nullptr) {
       ImageTrash *trash = new ImageTrash();
-      connect(lastImageHandler, &ImageHandler::inputImg, trash, &ImageTrash::onInputImg);
-      connect(lastImageHandler, &ImageHandler::last, trash, &ImageTrash::onLast);
+      connectImage(lastImageHandler, trash, &ImageTrash::onInputImg);
+      connectLast(lastImageHandler, trash);
+      downstream[lastImageHandler].append(trash);
       append(trash);
 
       lastImageHandler = nullptr;
@@ -129,28 +574,199 @@ namespace timelapse {
     }
 
     if (lastInputHandler != nullptr) {
-      connect(lastInputHandler, &InputHandler::input, handler, &InputHandler::onInput);
-      connect(lastInputHandler, &InputHandler::last, handler, &InputHandler::onLast);
+      connectInput(lastInputHandler, handler, &InputHandler::onInput);
+      connectLast(lastInputHandler, handler);
 
     } else {
       throw runtime_error("Weird pipeline state");
     }
+    downstream[lastInputHandler].append(handler);
     lastInputHandler = handler;
     lastImageHandler = nullptr;
 
     append(handler);
   }
 
+  void Pipeline::operator<<(ImageHandler *handler) {
+    chain(lastInputHandler, lastImageHandler, handler);
+  }
+
+  void Pipeline::operator<<(InputHandler *handler) {
+    chain(lastInputHandler, lastImageHandler, handler);
+  }
+
+  PipelineBranch* Pipeline::fork() {
+    PipelineBranch *branch = new PipelineBranch(this, lastInputHandler, lastImageHandler);
+    branches.append(branch);
+    forkPoints.insert(lastImageHandler);
+    return branch;
+  }
+
+  PipelineBranch::PipelineBranch(Pipeline *pipeline, InputHandler *lastInputHandler, ImageHandler *lastImageHandler) :
+  pipeline(pipeline), lastInputHandler(lastInputHandler), lastImageHandler(lastImageHandler) {
+  }
+
+  void PipelineBranch::operator<<(ImageHandler *handler) {
+    pipeline->chain(lastInputHandler, lastImageHandler, handler);
+  }
+
+  void PipelineBranch::operator<<(InputHandler *handler) {
+    pipeline->chain(lastInputHandler, lastImageHandler, handler);
+  }
+
+  PipelineBranch* PipelineBranch::fork() {
+    PipelineBranch *branch = new PipelineBranch(pipeline, lastInputHandler, lastImageHandler);
+    pipeline->branches.append(branch);
+    pipeline->forkPoints.insert(lastImageHandler);
+    return branch;
+  }
+
+  bool Pipeline::requiredSize(PipelineHandler *handler, QSize &size) const {
+    for (PipelineHandler *next : downstream.value(handler)) {
+      if (qobject_cast<ImageTrash*>(next) != nullptr) {
+        // image is not used anymore
+        continue;
+      }
+      ImageHandler *imageHandler = qobject_cast<ImageHandler*>(next);
+      if (imageHandler == nullptr) {
+        return false;
+      }
+      QSize outputSize = imageHandler->outputSize();
+      if (outputSize.isValid() && !outputSize.isEmpty()) {
+        size = QSize(std::max(size.width(), outputSize.width()), std::max(size.height(), outputSize.height()));
+        continue;
+      }
+      if (!imageHandler->scaleInvariant() || !requiredSize(next, size)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Pipeline::pixelsRequired(PipelineHandler *handler, const InputImageInfo &info) const {
+    for (PipelineHandler *next : downstream.value(handler)) {
+      if (qobject_cast<ImageTrash*>(next) != nullptr) {
+        continue;
+      }
+      ImageHandler *imageHandler = qobject_cast<ImageHandler*>(next);
+      if (imageHandler == nullptr || imageHandler->pixelsRequired(info) || pixelsRequired(next, info)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Pipeline::sinkFinished() {
+    if (++finishedSinks == sinks.size()) {
+      if (!sequenceIndex.isNull()) {
+        sequenceIndex->save();
+      }
+      emit done();
+    }
+  }
+
   void Pipeline::process() {
-    // listen when last element finish their job
-    if (lastInputHandler != nullptr) {
-      connect(lastInputHandler, &InputHandler::last, this, &Pipeline::done);
-    } else if (lastImageHandler != nullptr) {
-      connect(lastImageHandler, &ImageHandler::last, this, &Pipeline::done);
-    } else {
+    // collect ends of all branches, handler that is followed by other handler is not a sink
+    QList<PipelineHandler*> tails;
+    tails << (lastInputHandler != nullptr ? (PipelineHandler*) lastInputHandler : (PipelineHandler*) lastImageHandler);
+    for (PipelineBranch *branch : branches) {
+      tails << (branch->lastInputHandler != nullptr ?
+        (PipelineHandler*) branch->lastInputHandler : (PipelineHandler*) branch->lastImageHandler);
+    }
+    sinks.clear();
+    for (PipelineHandler *tail : tails) {
+      if (tail != nullptr && !downstream.contains(tail) && !sinks.contains(tail)) {
+        sinks.append(tail);
+      }
+    }
+    if (sinks.isEmpty()) {
       throw logic_error("No handler in pipeline");
     }
 
+    // listen when last elements finish their job
+    finishedSinks = 0;
+    for (PipelineHandler *sink : sinks) {
+      connect(sink, &PipelineHandler::last, this, &Pipeline::sinkFinished);
+      ImageHandler *imageSink = qobject_cast<ImageHandler*>(sink);
+      if (imageSink != nullptr && flowControl != nullptr) {
+        // frames leaving the pipeline don't need the credit anymore
+        FlowControl *fc = flowControl;
+        connect(imageSink, &ImageHandler::inputImg, imageSink,
+          [fc](InputImageInfo info, [[maybe_unused]] Frame frame) {
+            fc->release(info.credit);
+          }, Qt::DirectConnection);
+      }
+    }
+
+    if (!sequenceIndex.isNull()) {
+      sequenceIndex->setFastLuminance(fastAnalysis);
+      // analysis passes don't decode images with indexed metadata
+      for (ImageHandler *loader : loaders) {
+        auto required = [this, loader](const InputImageInfo &info) {
+          return pixelsRequired(loader, info);
+        };
+        if (ImageLoader *singleLoader = qobject_cast<ImageLoader*>(loader)) {
+          singleLoader->setPixelsRequired(required);
+        } else if (ImageHandlerPool *pool = qobject_cast<ImageHandlerPool*>(loader)) {
+          pool->forEachHandler([required](ImageHandler *handler) {
+            if (ImageLoader *poolLoader = qobject_cast<ImageLoader*>(handler)) {
+              poolLoader->setPixelsRequired(required);
+            }
+          });
+        }
+      }
+    }
+
+    // decode images at reduced size when all following stages need smaller frames
+    for (ImageHandler *loader : loaders) {
+      QSize size;
+      if (!requiredSize(loader, size)) {
+        continue;
+      }
+      bool preview = false;
+      if (!size.isValid() || size.isEmpty()) {
+        // just analysis stages follow
+        if (!fastAnalysis) {
+          continue;
+        }
+        preview = true;
+        *verboseOutput << "Images for stage " << stageStats(loader)->name()
+          << " will be decoded at 1/8 scale for analysis" << endl;
+      } else {
+        *verboseOutput << "Images for stage " << stageStats(loader)->name()
+          << " may be decoded at reduced size, at least " << size.width() << "x" << size.height() << endl;
+      }
+      auto configure = [size, preview](ImageLoader *imageLoader) {
+        if (preview) {
+          imageLoader->setPreviewDecode(true);
+        } else {
+          imageLoader->setSizeHint(size);
+        }
+      };
+      if (ImageLoader *singleLoader = qobject_cast<ImageLoader*>(loader)) {
+        configure(singleLoader);
+      } else if (ImageHandlerPool *pool = qobject_cast<ImageHandlerPool*>(loader)) {
+        pool->forEachHandler([configure](ImageHandler *handler) {
+          if (ImageLoader *poolLoader = qobject_cast<ImageLoader*>(handler)) {
+            configure(poolLoader);
+          }
+        });
+      }
+    }
+
+    if (trace != nullptr) {
+      for (PipelineHandler *handler : elements) {
+        if (ImageHandlerPool *pool = qobject_cast<ImageHandlerPool*>(handler)) {
+          pool->setTrace(trace);
+        }
+      }
+    }
+
+    for (QThread *thread : threads) {
+      thread->start();
+    }
+
+    wallTimer.start();
     emit src->process();
   }
 }
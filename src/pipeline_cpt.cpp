@@ -206,23 +206,19 @@ namespace timelapse {
       capturedImage.read(blob, format.toStdString());
     }
 
-    QDateTime now = QDateTime::currentDateTime();
-    QString exifDateTime = now.toString("yyyy:MM:dd HH:mm:ss");\
-          
-    // ImageMagick don't support writing of exif data
-    // TODO: setup exif timestamp correctly
-    capturedImage.attribute("EXIF:DateTime", exifDateTime.toStdString());
-    //capturedImage.defineValue("EXIF", "DateTime", exifDateTime.toStdString());
+    // decoded frame don't carry EXIF data, capture time is passed with image info
+    Frame frame = Frame::fromImage(capturedImage);
 
     InputImageInfo ii;
-    ii.width = capturedImage.columns();
-    ii.height = capturedImage.rows();
+    ii.width = frame.width();
+    ii.height = frame.height();
     ii.frame = capturedCnt;
+    ii.timestamp = QDateTime::currentDateTime();
 
-    emit inputImg(ii, capturedImage);
+    emit inputImg(ii, frame);
   }
 
-  void PipelineCaptureSource::onInputImg([[maybe_unused]] InputImageInfo info, [[maybe_unused]] Magick::Image img) {
+  void PipelineCaptureSource::onInputImg([[maybe_unused]] InputImageInfo info, [[maybe_unused]] Frame frame) {
     // ignore, we are the source
   }
 
@@ -24,12 +24,10 @@
 #include <QtCore/QTextStream>
 #include <QtCore/QString>
 
-#include <Magick++.h>
-#include <ImageMagick-6/Magick++/Color.h>
-
+#include <algorithm>
+#include <cmath>
 #include <exception>
-#include <vector>
-#include <utility>
+#include <list>
 
 using namespace std;
 using namespace timelapse;
@@ -41,44 +39,84 @@ namespace timelapse {
   verboseOutput(_verboseOutput) {
   }
 
-  double ComputeLuminance::computeLuminance(
-    const std::vector<std::pair<Magick::Color, size_t>> &histogram,
-    double gamma) {
+  ComputeLuminance::Histograms ComputeLuminance::histograms(const Frame &frame) {
+    Histograms result;
+    for (std::array<uint64_t, 256> &h : result) {
+      h.fill(0);
+    }
+    int width = frame.width();
+    int channels = frame.channels();
+    for (int c = 0; c < 3; c++) {
+      // gray frame is counted to all channels
+      int channel = std::min(c, channels - 1);
+      std::array<uint64_t, 256> &h = result[c];
+      for (int y = 0; y < frame.height(); y++) {
+        if (frame.layout() == Frame::Planar) {
+          const uint8_t *line = frame.constLine(y, channel);
+          for (int x = 0; x < width; x++) {
+            h[line[x]]++;
+          }
+        } else {
+          const uint8_t *line = frame.constLine(y) + channel;
+          for (int x = 0; x < width; x++) {
+            h[line[x * channels]]++;
+          }
+        }
+      }
+    }
+    return result;
+  }
 
+  double ComputeLuminance::computeLuminance(const Histograms &histograms, double gamma) {
     double powArg = 1.0 / gamma;
-    unsigned long sumR = 0;
-    unsigned long sumG = 0;
-    unsigned long sumB = 0;
-    unsigned long pixelCount = 0;
-    for (std::pair<Magick::Color, size_t> p : histogram) {
-      pixelCount += p.second;
-      sumR += p.second * Magick::Color::scaleDoubleToQuantum(
-        std::pow(Magick::Color::scaleQuantumToDouble(p.first.redQuantum()), powArg));
-      sumG += p.second * Magick::Color::scaleDoubleToQuantum(
-        std::pow(Magick::Color::scaleQuantumToDouble(p.first.greenQuantum()), powArg));
-      sumB += p.second * Magick::Color::scaleDoubleToQuantum(
-        std::pow(Magick::Color::scaleQuantumToDouble(p.first.blueQuantum()), powArg));
+    double sums[3] = {0, 0, 0};
+    uint64_t pixelCount = 0;
+    for (int v = 0; v < 256; v++) {
+      double corrected = 255.0 * std::pow(v / 255.0, powArg);
+      for (int c = 0; c < 3; c++) {
+        sums[c] += histograms[c][v] * corrected;
+      }
+      pixelCount += histograms[0][v];
+    }
+    if (pixelCount == 0) {
+      return 0;
     }
 
     // We use the following formula to get the perceived luminance.
-    return 0.299 * ((double) sumR / (double) pixelCount)
-      + 0.587 * ((double) sumG / (double) pixelCount)
-      + 0.114 * ((double) sumB / (double) pixelCount);
+    return 0.299 * (sums[0] / (double) pixelCount)
+      + 0.587 * (sums[1] / (double) pixelCount)
+      + 0.114 * (sums[2] / (double) pixelCount);
   }
 
-  void ComputeLuminance::onInputImg(InputImageInfo info, Magick::Image img) {
+  void ComputeLuminance::setSequenceIndex(SequenceIndex *index) {
+    sequenceIndex = index;
+  }
 
-    Magick::Image::ImageStatistics stat;
-    img.statistics(&stat);
+  bool ComputeLuminance::pixelsRequired(const InputImageInfo &info) const {
+    // luminance from the index is used as is
+    return sequenceIndex == nullptr || info.luminance < 0;
+  }
 
-    // We use the following formula to get the perceived luminance.
-    info.luminance = 0.299 * stat.red.mean + 0.587 * stat.green.mean + 0.114 * stat.blue.mean;
+  void ComputeLuminance::onInputImg(InputImageInfo info, Frame frame) {
+
+    if (sequenceIndex != nullptr && info.luminance >= 0) {
+      *verboseOutput << info.fileInfo().filePath()
+        << " luminance from index: " << info.luminance
+        << endl;
+      emit inputImg(info, frame);
+      return;
+    }
+
+    info.luminance = computeLuminance(histograms(frame));
 
     *verboseOutput << info.fileInfo().filePath()
       << " luminance: " << info.luminance
       << endl;
+    if (sequenceIndex != nullptr) {
+      sequenceIndex->update(info);
+    }
 
-    emit inputImg(info, img);
+    emit inputImg(info, frame);
   }
 
   ComputeAverageLuminance::ComputeAverageLuminance(QTextStream *_verboseOutput) :
@@ -105,34 +143,32 @@ namespace timelapse {
   }
 
   WMALuminance::WMALuminance(QTextStream *_verboseOutput, size_t _count) :
-  count(_count), verboseOutput(_verboseOutput), inputs() {
+  count(_count), verboseOutput(_verboseOutput) {
     if (count < 1)
       throw std::logic_error("Count for weighted moving average have to be greater than 0.");
   }
 
-  void WMALuminance::onInput(InputImageInfo info) {
-    inputs.append(info);
+  void WMALuminance::onInput(InputImageInfo in) {
+    // average depends just on previous images, so input may be emitted immediately
+    queue.push_back(in.luminance);
+    if (queue.size() > count)
+      queue.pop_front();
+    double sum = 0;
+    double sumWeight = 0;
+    size_t i = 1;
+    for (double d : queue) {
+      double w = (double) i / (double) queue.size();
+      sum += w * d;
+      sumWeight += w;
+      i++;
+    }
+
+    in.luminanceChange = (sum / sumWeight) - in.luminance;
+    emit input(in);
   }
 
   void WMALuminance::onLast() {
-    std::list<double> queue;
-    for (InputImageInfo in : inputs) {
-      queue.push_back(in.luminance);
-      if (queue.size() > count)
-        queue.pop_front();
-      double sum = 0;
-      double sumWeight = 0;
-      size_t i = 1;
-      for (double d : queue) {
-        double w = (double) i / (double) queue.size();
-        sum += w * d;
-        sumWeight += w;
-        i++;
-      }
-
-      in.luminanceChange = (sum / sumWeight) - in.luminance;
-      emit input(in);
-    }
+    queue.clear();
     emit last();
   }
 
@@ -140,10 +176,20 @@ namespace timelapse {
   verboseOutput(_verboseOutput), debugView(_debugView) {
   }
 
-  void AdjustLuminance::onInputImg(InputImageInfo info, Magick::Image img) {
-    std::vector<std::pair < Magick::Color, size_t>> histogram;
-    Magick::colorHistogram(&histogram, img);
-    Magick::Image original = img;
+  bool AdjustLuminance::pixelMap(const InputImageInfo &info, const Frame &frame, PixelMap &map) {
+    // debug view keeps left half of the image original
+    if (debugView && !map.split(frame.width() / 2)) {
+      return false;
+    }
+    ComputeLuminance::Histograms original = ComputeLuminance::histograms(frame);
+    // histograms of the frame after maps of previous fused stages
+    ComputeLuminance::Histograms histograms{};
+    for (int c = 0; c < 3; c++) {
+      const Lut &lut = map.lut(c);
+      for (int v = 0; v < 256; v++) {
+        histograms[c][lut[v]] += original[c][v];
+      }
+    }
     /* gamma correction rules:
      * http://www.imagemagick.org/Usage/transform/#evaluate_pow
      * 
@@ -165,10 +211,10 @@ namespace timelapse {
     for (int iteration = 0; iteration < 10; iteration++) {
 
       gamma *= 1 / (
-        std::log(Magick::Color::scaleQuantumToDouble(targetLuminance)) /
-        std::log(Magick::Color::scaleQuantumToDouble(expectedLuminance)));
+        std::log(targetLuminance / 255.0) /
+        std::log(expectedLuminance / 255.0));
 
-      expectedLuminance = ComputeLuminance::computeLuminance(histogram, gamma);
+      expectedLuminance = ComputeLuminance::computeLuminance(histograms, gamma);
 
       *verboseOutput << QString("%1 iteration %2 changing gamma to %3 (expected luminance: %4, target %5, abs(diff) %6)")
         .arg(info.fileInfo().filePath())
@@ -180,17 +226,12 @@ namespace timelapse {
         << endl;
     }
 
-    img.gamma(gamma);
-    if (debugView) {
-      original.transform(
-        Magick::Geometry(original.columns(), original.rows()),
-        Magick::Geometry(original.columns() / 2, original.rows())
-        );
-      img.composite(original, 0, 0, Magick::DissolveCompositeOp);
+    Lut lut;
+    for (int v = 0; v < 256; v++) {
+      lut[v] = (uint8_t) std::lround(std::min(255.0, 255.0 * std::pow(v / 255.0, 1.0 / gamma)));
     }
-    //img.brightnessContrast(brighnessChange, /* contrast */0.0);
-    emit inputImg(info, img);
+    map.map(lut, -1, debugView ? PixelMap::Right : PixelMap::All);
+    return true;
   }
 
 }
-
@@ -0,0 +1,158 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/pipeline_flow_control.h>
+
+#include <QtCore/QMutexLocker>
+
+#include <stdexcept>
+
+namespace timelapse {
+
+  FlowControl::FlowControl(int maxFrames, int64_t maxBytes) :
+  maxFrames(maxFrames), maxBytes(maxBytes) {
+
+    if (maxFrames < MIN_IN_FLIGHT_FRAMES) {
+      throw std::invalid_argument(QString("Maximum of in-flight frames have to be at least %1!")
+        .arg(MIN_IN_FLIGHT_FRAMES).toStdString());
+    }
+  }
+
+  bool FlowControl::available() const {
+    if (closed || credits.size() < MIN_IN_FLIGHT_FRAMES) {
+      return true;
+    }
+    if (credits.size() >= maxFrames) {
+      return false;
+    }
+    if (maxBytes > 0 && accountedFrames > 0) {
+      int64_t expected = accountedBytes / accountedFrames;
+      return bytes + expected <= maxBytes;
+    }
+    return true;
+  }
+
+  int64_t FlowControl::grant() {
+    int64_t credit = nextCredit++;
+    credits.insert(credit, 0);
+    return credit;
+  }
+
+  int64_t FlowControl::tryAcquire() {
+    QMutexLocker locker(&mutex);
+    if (!available()) {
+      return -1;
+    }
+    return grant();
+  }
+
+  int64_t FlowControl::acquire() {
+    QMutexLocker locker(&mutex);
+    while (!available()) {
+      condition.wait(&mutex);
+    }
+    return grant();
+  }
+
+  void FlowControl::account(int64_t credit, int64_t frameBytes) {
+    QMutexLocker locker(&mutex);
+    auto it = credits.find(credit);
+    if (it == credits.end()) {
+      return;
+    }
+    bytes += frameBytes - it.value();
+    it.value() = frameBytes;
+    accountedFrames++;
+    accountedBytes += frameBytes;
+  }
+
+  void FlowControl::release(int64_t credit) {
+    if (credit < 0) {
+      return;
+    }
+    {
+      QMutexLocker locker(&mutex);
+      auto it = credits.find(credit);
+      if (it == credits.end()) {
+        return;
+      }
+      bytes -= it.value();
+      credits.erase(it);
+      condition.wakeAll();
+    }
+    emit released();
+  }
+
+  void FlowControl::close() {
+    QMutexLocker locker(&mutex);
+    closed = true;
+    condition.wakeAll();
+  }
+
+  int FlowControl::inFlight() {
+    QMutexLocker locker(&mutex);
+    return credits.size();
+  }
+
+  int64_t FlowControl::inFlightBytes() {
+    QMutexLocker locker(&mutex);
+    return bytes;
+  }
+
+  CreditTracker::CreditTracker(FlowControl *flowControl) :
+  flowControl(flowControl) {
+  }
+
+  void CreditTracker::onInput(int64_t credit) {
+    if (credit >= 0) {
+      held.append(qMakePair(credit, false));
+    }
+  }
+
+  void CreditTracker::onOutput(int64_t credit) {
+    if (credit < 0) {
+      return;
+    }
+    int i = 0;
+    while (i < held.size() && held[i].first != credit) {
+      i++;
+    }
+    if (i == held.size()) {
+      return; // credit acquired by the handler itself
+    }
+    // frames received before this one will not be emitted anymore
+    for (int j = 0; j < i; j++) {
+      if (!held.first().second) {
+        flowControl->release(held.first().first);
+      }
+      held.removeFirst();
+    }
+    held.first().second = true;
+  }
+
+  void CreditTracker::onLast() {
+    for (const auto &p : held) {
+      if (!p.second) {
+        flowControl->release(p.first);
+      }
+    }
+    held.clear();
+  }
+
+}
@@ -0,0 +1,155 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/pipeline_frame_cache.h>
+
+#include <QtCore/QTextStream>
+
+#include <stdexcept>
+
+namespace timelapse {
+
+  /**
+   * Scratch file with its mapping. Frames wrapping mapped memory keep
+   * shared pointer to it, so the mapping lives until the last frame is released.
+   */
+  class FrameCacheSeparator::ScratchFile {
+  public:
+    explicit ScratchFile(const QString &dir) :
+    file(dir + QDir::separator() + "timelapse_frames_XXXXXX.raw") {
+      file.setAutoRemove(true);
+    }
+
+    ~ScratchFile() {
+      if (mapped != nullptr) {
+        file.unmap(mapped);
+      }
+    }
+
+    QTemporaryFile file;
+    uchar *mapped{nullptr};
+  };
+
+  FrameCacheSeparator::FrameCacheSeparator(QTextStream *verboseOutput, QTextStream *err,
+    int64_t memoryBudget, const QString &scratchDir) :
+  verboseOutput(verboseOutput), err(err), memoryBudget(memoryBudget), scratchDir(scratchDir) {
+    if (memoryBudget < 0) {
+      throw std::invalid_argument("Frame cache memory can't be negative!");
+    }
+  }
+
+  FrameCacheSeparator::~FrameCacheSeparator() {
+  }
+
+  void FrameCacheSeparator::setFlowControl(FlowControl *_flowControl) {
+    flowControl = _flowControl;
+  }
+
+  bool FrameCacheSeparator::spill(Entry &entry, const Frame &frame) {
+    if (scratch.isNull()) {
+      scratch = QSharedPointer<ScratchFile>(new ScratchFile(scratchDir));
+      if (!scratch->file.open()) {
+        emit error(QString("Can't create frame cache file in %1: %2")
+          .arg(scratchDir).arg(scratch->file.errorString()));
+        return false;
+      }
+      *verboseOutput << "Frame cache memory exhausted, spilling frames to " << scratch->file.fileName() << endl;
+    }
+
+    // write lines without padding
+    int planes = frame.layout() == Frame::Planar ? frame.channels() : 1;
+    int lineBytes = frame.layout() == Frame::Planar ? frame.width() : frame.width() * frame.channels();
+    entry.offset = scratchSize;
+    for (int p = 0; p < planes; p++) {
+      for (int y = 0; y < frame.height(); y++) {
+        const char *line = reinterpret_cast<const char*>(frame.constLine(y, p));
+        if (scratch->file.write(line, lineBytes) != lineBytes) {
+          emit error(QString("Failed to write frame cache file %1: %2")
+            .arg(scratch->file.fileName()).arg(scratch->file.errorString()));
+          return false;
+        }
+      }
+    }
+    scratchSize += (int64_t) planes * lineBytes * frame.height();
+    return true;
+  }
+
+  void FrameCacheSeparator::onInputImg(InputImageInfo info, Frame frame) {
+    // cache holds the frame from now, it is not limited by flow control
+    if (flowControl != nullptr) {
+      flowControl->release(info.credit);
+    }
+    info.credit = -1;
+
+    Entry entry;
+    entry.info = info;
+    entry.width = frame.width();
+    entry.height = frame.height();
+    entry.channels = frame.channels();
+    entry.layout = frame.layout();
+    if (memoryUsed + frame.byteSize() <= memoryBudget) {
+      entry.frame = frame;
+      memoryUsed += frame.byteSize();
+    } else if (!spill(entry, frame)) {
+      return;
+    }
+    entries.append(entry);
+  }
+
+  void FrameCacheSeparator::onLast() {
+    if (!scratch.isNull() && scratchSize > 0) {
+      scratch->file.flush();
+      // private mapping, handlers may modify frame data without touching the file
+      scratch->mapped = scratch->file.map(0, scratchSize, QFileDevice::MapPrivateOption);
+      if (scratch->mapped == nullptr) {
+        emit error(QString("Failed to map frame cache file %1: %2")
+          .arg(scratch->file.fileName()).arg(scratch->file.errorString()));
+        entries.clear();
+        scratch.clear();
+        emit last();
+        return;
+      }
+      *verboseOutput << "Frame cache: " << (memoryUsed / (1024 * 1024)) << " MiB in memory, "
+        << (scratchSize / (1024 * 1024)) << " MiB in " << scratch->file.fileName() << endl;
+    }
+
+    QSharedPointer<ScratchFile> mapping = scratch;
+    scratch.clear();
+    QList<Entry> cached = entries;
+    entries.clear();
+    memoryUsed = 0;
+    scratchSize = 0;
+
+    while (!cached.isEmpty()) {
+      Entry entry = cached.takeFirst();
+      Frame frame = entry.frame;
+      if (frame.isNull()) {
+        int stride = entry.layout == Frame::Planar ? entry.width : entry.width * entry.channels;
+        frame = Frame::wrap(mapping->mapped + entry.offset, entry.width, entry.height, stride,
+          entry.channels, entry.layout, [mapping](uint8_t *) {
+            // mapping is released with the last frame
+          });
+      }
+      entry.frame = Frame();
+      emit inputImg(entry.info, frame);
+    }
+    emit last();
+  }
+
+}
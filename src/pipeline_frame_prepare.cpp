@@ -20,14 +20,14 @@
 #include <TimeLapse/pipeline_frame_prepare.h>
 
 #include <TimeLapse/timelapse.h>
+#include <TimeLapse/blend_kernel.h>
 
 #include <QtCore/QTextStream>
 
-#include <Magick++.h>
-#include <exception>
-#include <ImageMagick-6/Magick++/Color.h>
-
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <stdexcept>
 
 using namespace std;
 using namespace timelapse;
@@ -39,20 +39,22 @@ namespace timelapse {
   verboseOutput(_verboseOutput), frameCount(_frameCount)  {
   }
 
-  void FramePrepare::blend(InputImageInfo info1, const Magick::Image *img1, InputImageInfo info2, [[maybe_unused]] const Magick::Image *img2) {
-    for (int f = info1.frame; f < info2.frame; f++) {
-      InputImageInfo i = info1;
-      i.frame = f;
-      emit inputImg(i, *img1);
+  void FramePrepare::blend(InputImageInfo info1, const Frame *img1, InputImageInfo info2, [[maybe_unused]] const Frame *img2) {
+    if (info2.frame <= info1.frame) {
+      return;
     }
+    // the same frame is emitted once, sink repeats it
+    InputImageInfo i = info1;
+    i.repeat = info2.frame - info1.frame;
+    emit inputImg(i, *img1);
   }
 
-  void FramePrepare::onInputImg(InputImageInfo info, Magick::Image img) {
+  void FramePrepare::onInputImg(InputImageInfo info, Frame frame) {
     if (prevImage != nullptr) {
-      blend(prevInfo, prevImage, info, &img);
+      blend(prevInfo, prevImage, info, &frame);
       delete prevImage;
     }
-    prevImage = new Magick::Image(img);
+    prevImage = new Frame(frame);
     prevInfo = info;
   }
 
@@ -72,29 +74,57 @@ namespace timelapse {
 
   BlendFramePrepare::BlendFramePrepare(QTextStream *verboseOutput, int _frameCount) :
   FramePrepare(verboseOutput, _frameCount) {
+    *verboseOutput << "Frame blending uses " << crossfadeImplementation() << " kernel" << endl;
+  }
 
+  Frame BlendFramePrepare::blendFrames(const Frame &a, const Frame &_b, double opacity, FramePool *pool) {
+    if (a.width() != _b.width() || a.height() != _b.height() || a.channels() != _b.channels()) {
+      throw std::invalid_argument("Blended frames have different geometry");
+    }
+    Frame b = _b.converted(a.layout());
+    Frame result = pool != nullptr ?
+      pool->acquire(a.width(), a.height(), a.channels(), a.layout()) :
+      Frame(a.width(), a.height(), a.channels(), a.layout());
+
+    // fixed point weights, 256 = 1.0
+    uint32_t weightA = (uint32_t) std::lround(std::max(0.0, std::min(1.0, opacity)) * 256);
+    int planes = a.layout() == Frame::Planar ? a.channels() : 1;
+    int lineBytes = a.layout() == Frame::Planar ? a.width() : a.width() * a.channels();
+    for (int p = 0; p < planes; p++) {
+      for (int y = 0; y < a.height(); y++) {
+        const uint8_t *la = a.constLine(y, p);
+        const uint8_t *lb = b.constLine(y, p);
+        uint8_t *out = result.line(y, p);
+        crossfade(la, lb, out, lineBytes, weightA);
+      }
+    }
+    return result;
   }
 
-  void BlendFramePrepare::blend(InputImageInfo info1, const Magick::Image *img1, InputImageInfo info2, const Magick::Image *img2) {
+  void BlendFramePrepare::blend(InputImageInfo info1, const Frame *img1, InputImageInfo info2, const Frame *img2) {
     assert(img1!=nullptr);
     int f1 = info1.frame;
     int f2 = info2.frame;
     *verboseOutput << "Blending images for frames " << f1 << " ... " << f2 << endl;
+    if (img2 == nullptr && f2 > f1) {
+      // nothing to blend with, all frames are the same
+      InputImageInfo i = info1;
+      i.repeat = f2 - f1;
+      emit inputImg(i, *img1);
+      return;
+    }
     for (int f = f1; f < f2; f++) {
-      Magick::Image blended = *img1;
+      Frame blended = *img1;
 
       double opacity = 1.0 - ((double) (f - f1) / ((double) (f2 - f1)));
       if (f - f1 > 0 && img2 != nullptr) { // for 100 % transparency, we don't have to composite
-        Magick::Image secondLayer = *img2;
         *verboseOutput << "Blend with next image with " << (opacity * 100) << " % transparency" << endl;
-        
-        //secondLayer.opacity(((double) QuantumRange) * opacity);
-        secondLayer.opacity(Magick::Color::scaleDoubleToQuantum(opacity));
-        blended.composite(secondLayer, 0, 0, Magick::DissolveCompositeOp);
+        blended = blendFrames(*img1, *img2, opacity, &pool);
       }
       //writeFrame(f, blended);      
       InputImageInfo i = info1;
       i.frame = f;
+      i.repeat = 1;
       emit inputImg(i, blended);
     }
   }
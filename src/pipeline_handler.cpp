@@ -27,6 +27,13 @@
 #include <QtCore/QTextStream>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QString>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
 
 using namespace std;
 using namespace timelapse;
@@ -39,7 +46,50 @@ namespace timelapse {
     emit last();
   }
 
-  void ImageLoader::onInputImg(InputImageInfo info, [[maybe_unused]] Magick::Image img) {
+  namespace {
+    class DecodeTask : public QRunnable {
+    public:
+      DecodeTask(InputImageInfo info, QSize sizeHint, bool preview, DecodedFrameCache *cache,
+                 std::function<void(const ImageLoader::Decoded&)> done) :
+      info(info), sizeHint(sizeHint), preview(preview), cache(cache), done(done) {
+        setAutoDelete(true);
+      }
+
+      void run() override {
+        ImageLoader::Decoded decoded;
+        ImageLoader::decode(info, sizeHint, preview, cache, decoded);
+        done(decoded);
+      }
+
+    private:
+      InputImageInfo info;
+      QSize sizeHint;
+      bool preview;
+      DecodedFrameCache *cache;
+      std::function<void(const ImageLoader::Decoded&)> done;
+    };
+
+    class MetadataTask : public QRunnable {
+    public:
+      MetadataTask(QString path, std::function<void(bool, const ImageMetadata&, const QString&)> done) :
+      path(path), done(done) {
+        setAutoDelete(true);
+      }
+
+      void run() override {
+        ImageMetadata metadata;
+        QString error;
+        bool ok = ImageMetadataParser::read(path, metadata, error);
+        done(ok, metadata, error);
+      }
+
+    private:
+      QString path;
+      std::function<void(bool, const ImageMetadata&, const QString&)> done;
+    };
+  }
+
+  void ImageLoader::onInputImg(InputImageInfo info, [[maybe_unused]] Frame frame) {
     // load image again
     onInput(info);
   }
@@ -48,38 +98,229 @@ namespace timelapse {
   verboseOutput(_verboseOutput), err(_err), stage(_stage) {
   }
 
-  void ImageLoader::onInput(InputImageInfo info) {
+  ImageLoader::~ImageLoader() {
+    if (decoderPool != nullptr) {
+      decoderPool->waitForDone();
+      delete decoderPool;
+    }
+    if (flowControl != nullptr) {
+      for (const auto &pending : readAheadQueue) {
+        flowControl->release(pending.first.credit);
+      }
+    }
+  }
+
+  void ImageLoader::setFlowControl(FlowControl *_flowControl) {
+    flowControl = _flowControl;
+  }
+
+  void ImageLoader::setReadAhead(int count) {
+    if (count < 0) {
+      throw std::invalid_argument("Read-ahead count can't be negative!");
+    }
+    readAhead = count;
+    if (readAhead > 0 && decoderPool == nullptr) {
+      decoderPool = new QThreadPool();
+    }
+    if (decoderPool != nullptr) {
+      decoderPool->setMaxThreadCount(std::max(1, readAhead));
+    }
+  }
+
+  void ImageLoader::setSizeHint(const QSize &size) {
+    sizeHint = size;
+  }
+
+  void ImageLoader::setPreviewDecode(bool preview) {
+    previewDecode = preview;
+  }
+
+  void ImageLoader::setFrameCache(QSharedPointer<DecodedFrameCache> cache) {
+    frameCache = cache;
+  }
+
+  void ImageLoader::setSkipUndecodable(bool skip) {
+    skipUndecodable = skip;
+  }
+
+  void ImageLoader::setPixelsRequired(std::function<bool(const InputImageInfo&)> predicate) {
+    pixelsRequired = predicate;
+  }
+
+  void ImageLoader::decode(const InputImageInfo &info, const QSize &sizeHint, bool preview,
+    DecodedFrameCache *cache, Decoded &result) {
+
+    QElapsedTimer timer;
+    timer.start();
+    if (cache != nullptr && cache->load(info, sizeHint, preview, result.frame, result.depth)) {
+      result.usable = true;
+      result.cached = true;
+      result.durationMs = timer.elapsed();
+      result.done = true;
+      return;
+    }
+
     Magick::Image image;
-    bool usableImage = false;
     try {
-      ScopeLogger loadLogger(verboseOutput, QString("Loading %1").arg(info.fileInfo().filePath()));
+      if (preview) {
+        // the smallest possible DCT scale, libjpeg decodes just DC coefficients for 1/8
+        image.defineValue("jpeg", "size", "1x1");
+      } else if (sizeHint.isValid()) {
+        // JPEG decoder picks the smallest DCT scale (1/2, 1/4, 1/8) that is at least of this size
+        image.defineValue("jpeg", "size", QString("%1x%2").arg(sizeHint.width()).arg(sizeHint.height()).toStdString());
+      }
       image.read(info.filePath);
-      usableImage = true;
+      result.usable = true;
     } catch (Magick::WarningCoder &warning) {
       // Process coder warning while loading
-      *err << "Coder Warning: " << QString::fromUtf8(warning.what()) << endl;
-      usableImage = true;
+      result.warning = "Coder Warning: " + QString::fromUtf8(warning.what());
+      result.usable = true;
     } catch (Magick::Warning &warning) {
-      // Handle any other Magick++ warning. 
-      *err << "Warning: " << QString::fromUtf8(warning.what()) << endl;
-      usableImage = true;
+      // Handle any other Magick++ warning.
+      result.warning = "Warning: " + QString::fromUtf8(warning.what());
+      result.usable = true;
     } catch (Magick::Error &e) {
-      // Process other Magick++ 
-      emit error(QString("Failed to load file as image (%1). Reason: %2")
+      // Process other Magick++
+      result.error = QString("Failed to load file as image (%1). Reason: %2")
         .arg(info.fileInfo().filePath())
-        .arg(e.what()));
+        .arg(e.what());
+    }
+    if (result.usable) {
+      if (preview && image.magick() != "JPEG") {
+        // format without scaled decoding, scale it down at least
+        image.scale(Magick::Geometry(std::max((size_t) 1, image.columns() / 8),
+                                     std::max((size_t) 1, image.rows() / 8)));
+      }
+      result.depth = image.depth();
+      result.frame = Frame::fromImage(image);
+      if (cache != nullptr) {
+        cache->store(info, sizeHint, preview, result.frame, result.depth);
+      }
     }
-    if (usableImage) {
+    result.durationMs = timer.elapsed();
+    result.done = true;
+  }
+
+  void ImageLoader::finish(InputImageInfo info, const Decoded &result) {
+    *verboseOutput << QString("Loading %1 ... %2 ms%3").arg(info.fileInfo().filePath()).arg(result.durationMs)
+      .arg(result.cached ? " (cached)" : (result.skipped ? " (skipped, pixels are not needed)" : "")) << endl;
+    if (!result.warning.isEmpty()) {
+      *err << result.warning << endl;
+    }
+    if (result.usable) {
+      if (result.depth > 8) {
+        *verboseOutput << info.fileInfo().fileName() << " has " << result.depth
+          << " bits per channel, reducing to 8 bits" << endl;
+      }
+      if (flowControl != nullptr) {
+        flowControl->account(info.credit, result.frame.byteSize());
+      }
       emit onImageLoaded(stage, cnt++);
-      emit inputImg(info, image);
+      emit inputImg(info, result.frame);
+    } else {
+      if (flowControl != nullptr) {
+        flowControl->release(info.credit);
+      }
+      if (skipUndecodable) {
+        *err << result.error << ", skipping it" << endl;
+        return;
+      }
+      emit error(result.error);
     }
   }
 
+  void ImageLoader::onInput(InputImageInfo info) {
+    while (flowControl != nullptr && info.credit < 0) {
+      info.credit = flowControl->tryAcquire();
+      if (info.credit < 0) {
+        if (readAheadQueue.isEmpty()) {
+          info.credit = flowControl->acquire();
+        } else {
+          // credits may be held by decoded images waiting in read-ahead queue
+          waitForHead();
+          drainReadAhead();
+        }
+      }
+    }
+
+    bool skip = pixelsRequired && !pixelsRequired(info);
+    if (readAhead <= 0) {
+      Decoded result;
+      if (skip) {
+        result.usable = result.skipped = result.done = true;
+      } else {
+        decode(info, sizeHint, previewDecode, frameCache.data(), result);
+      }
+      finish(info, result);
+      return;
+    }
+
+    while (readAheadQueue.size() >= readAhead) {
+      waitForHead();
+      drainReadAhead();
+    }
+    QSharedPointer<Decoded> result(new Decoded());
+    if (skip) {
+      // keep input order with images decoded ahead
+      result->usable = result->skipped = result->done = true;
+      readAheadQueue.append(qMakePair(info, result));
+      drainReadAhead();
+      return;
+    }
+    readAheadQueue.append(qMakePair(info, result));
+    decoderPool->start(new DecodeTask(info, sizeHint, previewDecode, frameCache.data(), [this, result](const Decoded &decoded) {
+      {
+        QMutexLocker locker(&readAheadMutex);
+        *result = decoded;
+        readAheadCondition.wakeAll();
+      }
+      // emit decoded image even when there is no other input
+      QMetaObject::invokeMethod(this, [this]() {
+        drainReadAhead();
+      }, Qt::QueuedConnection);
+    }));
+  }
+
+  void ImageLoader::waitForHead() {
+    QMutexLocker locker(&readAheadMutex);
+    while (!readAheadQueue.isEmpty() && !readAheadQueue.first().second->done) {
+      readAheadCondition.wait(&readAheadMutex);
+    }
+  }
+
+  void ImageLoader::drainReadAhead() {
+    for (;;) {
+      QPair<InputImageInfo, QSharedPointer<Decoded>> head;
+      {
+        QMutexLocker locker(&readAheadMutex);
+        if (readAheadQueue.isEmpty() || !readAheadQueue.first().second->done) {
+          break;
+        }
+        head = readAheadQueue.takeFirst();
+      }
+      finish(head.first, *head.second);
+    }
+    if (lastReceived && readAheadQueue.isEmpty()) {
+      lastReceived = false;
+      emit last();
+    }
+  }
+
+  void ImageLoader::onLast() {
+    if (readAheadQueue.isEmpty()) {
+      emit last();
+      return;
+    }
+    // last is emitted after all pending images
+    lastReceived = true;
+    drainReadAhead();
+  }
+
   void ImageTrash::onInput(InputImageInfo info) {
     emit input(info);
   }
 
-  void ImageTrash::onInputImg(InputImageInfo info, [[maybe_unused]] Magick::Image img) {
+  void ImageTrash::onInputImg(InputImageInfo info, [[maybe_unused]] Frame frame) {
     emit input(info);
   }
 
@@ -94,29 +335,110 @@ namespace timelapse {
     emit last();
   }
 
-  ImageMetadataReader::ImageMetadataReader(QTextStream *_verboseOutput, QTextStream *_err) :
-  verboseOutput(_verboseOutput), err(_err) {
+  ImageMetadataReader::ImageMetadataReader(QTextStream *_verboseOutput, QTextStream *_err, int threads) :
+  verboseOutput(_verboseOutput), err(_err), pool(new QThreadPool()) {
+    if (threads <= 0) {
+      throw std::invalid_argument("Metadata reader thread count have to be positive!");
+    }
+    pool->setMaxThreadCount(threads);
+  }
+
+  ImageMetadataReader::~ImageMetadataReader() {
+    pool->waitForDone();
+    delete pool;
+  }
+
+  void ImageMetadataReader::setSequenceIndex(SequenceIndex *index) {
+    sequenceIndex = index;
   }
 
-  void ImageMetadataReader::onInputImg(InputImageInfo info, Magick::Image image) {
-    // read dimensions
-    info.width = image.baseColumns();
-    info.height = image.baseRows();
+  void ImageMetadataReader::onInput(InputImageInfo info) {
+    QSharedPointer<Result> result(new Result());
+    if (sequenceIndex != nullptr && info.timestamp.isValid()) {
+      // metadata from index
+      result->done = true;
+      result->ok = true;
+      result->metadata.width = info.width;
+      result->metadata.height = info.height;
+      {
+        QMutexLocker locker(&mutex);
+        queue.append(qMakePair(info, result));
+      }
+      drain();
+      return;
+    }
 
-    // read timestamp
-    QString exifDateTime = QString::fromStdString(image.attribute("EXIF:DateTime"));
+    {
+      QMutexLocker locker(&mutex);
+      queue.append(qMakePair(info, result));
+    }
+    QString path = info.fileInfo().filePath();
+    pool->start(new MetadataTask(path, [this, result](bool ok, const ImageMetadata &metadata, const QString &error) {
+      {
+        QMutexLocker locker(&mutex);
+        result->ok = ok;
+        result->metadata = metadata;
+        result->error = error;
+        result->done = true;
+      }
+      QMetaObject::invokeMethod(this, [this]() {
+        drain();
+      }, Qt::QueuedConnection);
+    }));
+  }
+
+  void ImageMetadataReader::finish(InputImageInfo info, const Result &result) {
+    if (sequenceIndex != nullptr && info.timestamp.isValid()) {
+      *verboseOutput << info.fileInfo().fileName() << " timestamp from index: "
+        << info.timestamp.toString(Qt::ISODate) << endl;
+      emit input(info);
+      return;
+    }
+
+    if (!result.ok) {
+      *err << "Failed to read metadata of " << info.fileInfo().fileName() << ": " << result.error << endl;
+    }
+    info.width = result.metadata.width;
+    info.height = result.metadata.height;
+    QString exifDateTime = result.metadata.exifDateTime;
     if (exifDateTime.length() == 0) {
       *err << "Image " << info.fileInfo().fileName() << " don't have EXIF:DateTime property. Using file modification time." << endl;
       info.timestamp = info.fileInfo().lastModified();
     } else {
-      // 2015:09:15 07:00:28
-      info.timestamp = QDateTime::fromString(exifDateTime, QString("yyyy:MM:dd HH:mm:ss"));
+      info.timestamp = result.metadata.timestamp();
     }
-    *verboseOutput << info.fileInfo().fileName() << " EXIF:DateTime : " << exifDateTime
+    *verboseOutput << info.fileInfo().fileName() << " " << info.width << "x" << info.height
+      << " EXIF:DateTime : " << exifDateTime
       << " (" << info.timestamp.toString(Qt::ISODate) << ")" << endl;
+    if (sequenceIndex != nullptr) {
+      sequenceIndex->update(info);
+    }
 
-    emit inputImg(info, image);
+    emit input(info);
   }
 
+  void ImageMetadataReader::drain() {
+    for (;;) {
+      QPair<InputImageInfo, QSharedPointer<Result>> head;
+      {
+        QMutexLocker locker(&mutex);
+        if (queue.isEmpty() || !queue.first().second->done) {
+          break;
+        }
+        head = queue.takeFirst();
+      }
+      finish(head.first, *head.second);
+    }
+    if (lastReceived && queue.isEmpty()) {
+      lastReceived = false;
+      emit last();
+    }
+  }
+
+  void ImageMetadataReader::onLast() {
+    // last is emitted after all pending inputs
+    lastReceived = true;
+    drain();
+  }
 
 }
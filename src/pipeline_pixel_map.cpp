@@ -0,0 +1,172 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/pipeline_pixel_map.h>
+
+#include <QtCore/QStringList>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+using namespace timelapse;
+
+namespace timelapse {
+
+  PixelMap::PixelMap() {
+    left.fill(identityLut());
+    right.fill(identityLut());
+  }
+
+  Lut PixelMap::identityLut() {
+    Lut lut;
+    for (int v = 0; v < 256; v++) {
+      lut[v] = (uint8_t) v;
+    }
+    return lut;
+  }
+
+  void PixelMap::map(const Lut &lut, int channel, Region region) {
+    for (int c = 0; c < 3; c++) {
+      if (channel >= 0 && c != channel) {
+        continue;
+      }
+      for (int v = 0; v < 256; v++) {
+        right[c][v] = lut[right[c][v]];
+        if (region == All) {
+          left[c][v] = lut[left[c][v]];
+        }
+      }
+    }
+  }
+
+  bool PixelMap::split(int x) {
+    if (splitX == 0) {
+      splitX = x;
+      left = right;
+      return true;
+    }
+    return splitX == x;
+  }
+
+  const Lut &PixelMap::lut(int channel) const {
+    return right[channel];
+  }
+
+  bool PixelMap::isIdentity() const {
+    Lut identity = identityLut();
+    for (int c = 0; c < 3; c++) {
+      if (left[c] != identity || right[c] != identity) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void PixelMap::apply(Frame &frame) const {
+    if (isIdentity()) {
+      return;
+    }
+    int width = frame.width();
+    int channels = frame.channels();
+    int splitColumn = std::min(splitX, width);
+    // alpha channel is not mapped
+    int colorChannels = std::min(channels, 3);
+    for (int y = 0; y < frame.height(); y++) {
+      if (frame.layout() == Frame::Planar) {
+        for (int c = 0; c < colorChannels; c++) {
+          uint8_t *line = frame.line(y, c);
+          const Lut &l = left[c];
+          const Lut &r = right[c];
+          for (int x = 0; x < splitColumn; x++) {
+            line[x] = l[line[x]];
+          }
+          for (int x = splitColumn; x < width; x++) {
+            line[x] = r[line[x]];
+          }
+        }
+      } else {
+        uint8_t *line = frame.line(y);
+        for (int x = 0; x < width; x++) {
+          const std::array<Lut, 3> &luts = x < splitColumn ? left : right;
+          uint8_t *pixel = line + x * channels;
+          for (int c = 0; c < colorChannels; c++) {
+            pixel[c] = luts[c][pixel[c]];
+          }
+        }
+      }
+    }
+  }
+
+  void PixelMapHandler::fuse(PixelMapHandler *next) {
+    fused.append(next);
+  }
+
+  QString PixelMapHandler::fusedName() const {
+    QStringList names;
+    names << metaObject()->className();
+    for (const PixelMapHandler *stage : fused) {
+      names << stage->metaObject()->className();
+    }
+    return names.join('+');
+  }
+
+  void PixelMapHandler::onInputImg(InputImageInfo info, Frame frame) {
+    PixelMap map;
+    auto compose = [&](PixelMapHandler *stage) {
+      if (stage->pixelMap(info, frame, map)) {
+        return true;
+      }
+      // mapping can't be composed, apply current map and start again
+      map.apply(frame);
+      map = PixelMap();
+      return stage->pixelMap(info, frame, map);
+    };
+    QList<PixelMapHandler*> stages;
+    stages << this << fused;
+    for (PixelMapHandler *stage : stages) {
+      if (!compose(stage)) {
+        emit error(QString("Pixel map of %1 can't be applied to %2")
+          .arg(stage->metaObject()->className())
+          .arg(info.fileInfo().filePath()));
+        return;
+      }
+    }
+    map.apply(frame);
+    emit inputImg(info, frame);
+  }
+
+  AdjustGain::AdjustGain(QTextStream *_verboseOutput, double gain) :
+  verboseOutput(_verboseOutput) {
+    if (gain <= 0) {
+      throw std::invalid_argument("Gain have to be positive!");
+    }
+    for (int v = 0; v < 256; v++) {
+      lut[v] = (uint8_t) std::lround(std::min(255.0, v * gain));
+    }
+  }
+
+  bool AdjustGain::pixelMap(const InputImageInfo &info, [[maybe_unused]] const Frame &frame, PixelMap &map) {
+    *verboseOutput << "Gain for " << info.fileInfo().fileName() << endl;
+    map.map(lut);
+    return true;
+  }
+
+}
@@ -21,6 +21,9 @@
 
 #include <TimeLapse/scope_log.h>
 
+#include <algorithm>
+#include <cmath>
+
 using namespace std;
 using namespace timelapse;
 
@@ -30,13 +33,41 @@ namespace timelapse {
     verboseOutput{verboseOutput}, width(w), height(h), adaptiveResize(adaptiveResize) {
   }
 
-  void ResizeFrame::onInputImg(InputImageInfo info, Magick::Image img) {
-    Magick::Image resized = img;
+  ResizeFrame::ResizeFrame(QTextStream *verboseOutput, int w, int h, Resampler::Filter filter, int threads) :
+    verboseOutput{verboseOutput}, width(w), height(h), adaptiveResize(false),
+    resampler(new Resampler(filter, threads)) {
+  }
+
+  QSize ResizeFrame::outputSize() const {
+    if (width <= 0) {
+      // width depends on input aspect ratio
+      return QSize();
+    }
+    return QSize(width, height);
+  }
+
+  void ResizeFrame::onInputImg(InputImageInfo info, Frame frame) {
+    int targetWidth = width;
+    if (targetWidth <= 0) {
+      targetWidth = std::max(1, (int) std::lround((double) frame.width() * height / frame.height()));
+    }
+    if (resampler) {
+      Frame resized;
+      {
+        ScopeLogger resizeLogger(verboseOutput, QString("Resampling image %1 x %2 to %3 x %4")
+                                   .arg(frame.width()).arg(frame.height())
+                                   .arg(targetWidth).arg(height));
+        resized = resampler->resize(frame, targetWidth, height);
+      }
+      emit inputImg(info, resized);
+      return;
+    }
+    Magick::Image resized = frame.toImage();
     {
       ScopeLogger resizeLogger(verboseOutput, QString("Resizing image %1 x %2 to %3 x %4")
                                  .arg(resized.columns()).arg(resized.rows())
-                                 .arg(width).arg(height));
-      Magick::Geometry g(width, height);
+                                 .arg(targetWidth).arg(height));
+      Magick::Geometry g(targetWidth, height);
       g.aspect(true);
 
       if (adaptiveResize) {
@@ -45,7 +76,7 @@ namespace timelapse {
         resized.resize(g);
       }
     }
-    emit inputImg(info, resized);
+    emit inputImg(info, Frame::fromImage(resized));
   }
 
 }
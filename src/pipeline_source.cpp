@@ -40,82 +40,121 @@ namespace timelapse {
     connect(this, &PipelineFileSource::processNext, this, &PipelineFileSource::takeNext, Qt::QueuedConnection);
   }
 
-  QList<InputImageInfo> PipelineFileSource::listDirectory(QDir d) {
-    *verboseOutput << "Dive into directory: " << d.path() << endl;
-    QList<InputImageInfo> inputs;
-    QFileInfoList l = d.entryInfoList(QDir::Files, QDir::Name);
-    *verboseOutput << "...found " << l.size() << " entries" << endl;
-    for (QFileInfo i2 : l) {
-      if (i2.isFile() || i2.isSymLink()) {
-        if (fileSuffixes.isEmpty() || fileSuffixes.contains(i2.completeSuffix(), Qt::CaseInsensitive)) {
-          *verboseOutput << "Input file: " << i2.filePath() << endl;
-          inputs.append(InputImageInfo(i2));
-        } else {
-          *verboseOutput << "Skip file: " << i2.filePath() << endl;
-        }
-      } else if (i2.isDir()) {
-        if (recursive) {
-          inputs.append(listDirectory(QDir(i2.filePath())));
-        } else {
-          *verboseOutput << "Ignore directory " << i2.filePath() << endl;
-        }
-      } else {
-        emit error(QString("Can't add input ") + i2.filePath());
-      }
+  PipelineFileSource::~PipelineFileSource() {
+    if (scanner != nullptr) {
+      delete scanner;
     }
-    return inputs;
   }
 
-  QList<InputImageInfo> PipelineFileSource::parseArguments() {
-    QList<InputImageInfo> inputs;
+  void PipelineFileSource::parseArguments() {
     *verboseOutput << "inputs: " << inputArguments.join(", ") << endl;
+    scanner = new DirectoryScanner(fileSuffixes, recursive);
+    connect(scanner, &DirectoryScanner::progress, this, &PipelineFileSource::onScanProgress, Qt::QueuedConnection);
+    connect(scanner, &DirectoryScanner::directoryListed, this, &PipelineFileSource::onDirectoryListed, Qt::QueuedConnection);
+    connect(scanner, &DirectoryScanner::error, this, &PipelineFileSource::error, Qt::QueuedConnection);
     for (QString inputArg : inputArguments) {
       QFileInfo i(inputArg);
       if (i.isFile() || i.isSymLink()) {
         *verboseOutput << "Input file: " << inputArg << endl;
-        inputs.append(InputImageInfo(i));
+        scanner->addFile(inputArg);
       } else if (i.isDir()) {
-        inputs.append(listDirectory(QDir(i.filePath())));
+        *verboseOutput << "Dive into directory: " << i.filePath() << endl;
+        scanner->addDirectory(i.filePath());
       } else {
         emit error(QString("Can't find input ") + inputArg);
       }
     }
-    if (inputs.empty())
-      emit error("No input images found!");
-
-    // check suffixes
-    QString suffix;
-    bool first = true;
-    for (InputImageInfo in : inputs) {
-      if (first) {
-        suffix = in.fileInfo().completeSuffix();
-        first = false;
-      } else {
-        if (suffix != in.fileInfo().completeSuffix()) {
-          *err << "Input files with multiple suffixes. Are you sure that this is one sequence?" << endl;
-          break;
-        }
-      }
-    }
+    scanner->start();
+  }
+
+  void PipelineFileSource::onDirectoryListed(QString path, int entries) {
+    *verboseOutput << "...found " << entries << " entries in " << path << endl;
+  }
 
-    return inputs;
+  void PipelineFileSource::onScanProgress() {
+    if (waitingForScan) {
+      waitingForScan = false;
+      takeNext();
+    }
   }
 
   void PipelineFileSource::onInput([[maybe_unused]] InputImageInfo info) {
     // just ignore, we are the source
   }
 
-  void PipelineFileSource::takeNext(QList<InputImageInfo> inputs) {
-    if (inputs.empty()) {
-      emit last();
-    } else {
-      emit input(inputs.takeFirst());
-      emit processNext(inputs);
+  void PipelineFileSource::setFlowControl(FlowControl *_flowControl) {
+    flowControl = _flowControl;
+    connect(flowControl, &FlowControl::released, this, &PipelineFileSource::onCreditReleased, Qt::QueuedConnection);
+  }
+
+  QStringList PipelineFileSource::imageSuffixes() {
+    return QStringList()
+      << "jpg" << "jpeg" << "jpe" << "png" << "tif" << "tiff" << "bmp" << "gif" << "webp"
+      << "ppm" << "pgm" << "pnm" << "pam" << "heic" << "heif" << "jp2"
+      // camera raw formats (decoded by ImageMagick delegate)
+      << "dng" << "cr2" << "cr3" << "nef" << "arw" << "orf" << "raf" << "rw2" << "pef" << "srw";
+  }
+
+  void PipelineFileSource::setSequenceIndex(SequenceIndex *index) {
+    sequenceIndex = index;
+  }
+
+  void PipelineFileSource::onCreditReleased() {
+    if (waitingForCredit) {
+      waitingForCredit = false;
+      takeNext();
+    }
+  }
+
+  void PipelineFileSource::takeNext() {
+    if (!hasPending) {
+      QFileInfo file;
+      DirectoryScanner::Status status = scanner->next(file);
+      if (status == DirectoryScanner::Pending) {
+        // continue when next directory is listed
+        waitingForScan = true;
+        return;
+      }
+      if (status == DirectoryScanner::Finished) {
+        if (emitted == 0) {
+          emit error("No input images found!");
+        }
+        emit last();
+        return;
+      }
+
+      // check suffixes
+      if (emitted == 0) {
+        firstSuffix = file.completeSuffix();
+      } else if (!suffixWarning && firstSuffix != file.completeSuffix()) {
+        *err << "Input files with multiple suffixes. Are you sure that this is one sequence?" << endl;
+        suffixWarning = true;
+      }
+
+      pending = InputImageInfo(file);
+      if (sequenceIndex != nullptr) {
+        sequenceIndex->lookup(pending);
+      }
+      hasPending = true;
+    }
+
+    if (flowControl != nullptr) {
+      pending.credit = flowControl->tryAcquire();
+      if (pending.credit < 0) {
+        // wait until downstream stages release some credit
+        waitingForCredit = true;
+        return;
+      }
     }
+    hasPending = false;
+    emitted++;
+    emit input(pending);
+    emit processNext();
   }
 
   void PipelineFileSource::process() {
-    emit processNext(parseArguments());
+    parseArguments();
+    emit processNext();
   }
 
 
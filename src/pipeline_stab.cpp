@@ -457,41 +457,34 @@ namespace timelapse {
     emit last();
   }
 
-  void PipelineStabDetect::onInputImg(InputImageInfo info, Magick::Image image) {
+  void PipelineStabDetect::onInputImg(InputImageInfo info, Frame frame) {
     try {
+      // vid.stab expects packed RGB24
+      frame = frame.converted(Frame::Interleaved);
+      if (frame.channels() != 3) {
+        throw runtime_error(QString("Unsupported channel count %1 of image %2").arg(frame.channels()).arg(info.fileInfo().fileName()).toStdString());
+      }
       if (!initialized) {
-        init(image);
+        init(frame);
       }
-      if (image.rows() != height || image.columns() != width) {
+      if ((uint32_t) frame.height() != height || (uint32_t) frame.width() != width) {
         throw runtime_error(QString("Not uniform image size! %").arg(info.fileInfo().fileName()).toStdString());
       }
 
-
-      Magick::Blob blob;
-      // set raw RGBS output format & convert it into a Blob  
-      if (image.depth() > 8) {
-        *err << "Warning: we lost some information by converting to 8bit depth (now " << image.depth() << ")" << endl;
-      }
-      image.depth(8);
-      image.magick("RGB");
-      image.write(&blob);
-
       LocalMotions localmotions;
-      VSFrame frame;
-      size_t dataLen = blob.length();
+      VSFrame vsFrame;
 
       Q_ASSERT(fi.planes == 1);
-      Q_ASSERT(dataLen == image.baseColumns() * image.baseRows() * 3);
 
-      if (stabConf->mdConf.show > 0) { // create copy of blob
-        frame.data[0] = new uint8_t[dataLen];
-        memcpy(frame.data[0], blob.data(), dataLen);
+      if (stabConf->mdConf.show > 0) {
+        // motion detection draws into the frame, frame data are detached from other copies
+        vsFrame.data[0] = frame.data();
       } else {
-        frame.data[0] = static_cast<uint8_t*>(const_cast<void*>(blob.data()));
+        vsFrame.data[0] = const_cast<uint8_t*>(frame.constData());
       }
-      frame.linesize[0] = image.baseColumns() * 3;
+      vsFrame.linesize[0] = frame.stride();
 
-      if (vsMotionDetection(&md, &localmotions, &frame) != VS_OK) {
+      if (vsMotionDetection(&md, &localmotions, &vsFrame) != VS_OK) {
         throw runtime_error("motion detection failed");
       } else {
         if (vsWriteToFile(&md, f, &localmotions) != VS_OK) {
@@ -500,27 +493,16 @@ namespace timelapse {
         vs_vector_del(&localmotions);
       }
 
-      if (stabConf->mdConf.show > 0) {
-        // if we want to store transformations, we have to create new image...
-        Magick::Geometry g(width, height);
-        Magick::Blob oblob(frame.data[0], dataLen);
-
-        Magick::Image oimage;
-        oimage.read(oblob, g, 8, "RGB");
-        delete[] frame.data[0];
-        emit inputImg(info, oimage);
-      } else {
-        emit inputImg(info, image);
-      }
+      emit inputImg(info, frame);
 
     } catch (exception &e) {
       emit error(e.what());
     }
   }
 
-  void PipelineStabDetect::init(Magick::Image img) {
-    width = img.columns();
-    height = img.rows();
+  void PipelineStabDetect::init(const Frame &frame) {
+    width = frame.width();
+    height = frame.height();
 
     if (!vsFrameInfoInit(&fi, width, height, PF_RGB24)) {
       throw runtime_error("Failed to initialize frame info");
@@ -576,40 +558,30 @@ namespace timelapse {
     emit last();
   }
 
-  void PipelineStabTransform::onInputImg(InputImageInfo info, Magick::Image image) {
+  void PipelineStabTransform::onInputImg(InputImageInfo info, Frame frame) {
     try {
+      // vid.stab expects packed RGB24
+      frame = frame.converted(Frame::Interleaved);
+      if (frame.channels() != 3) {
+        throw runtime_error(QString("Unsupported channel count %1 of image %2").arg(frame.channels()).arg(info.fileInfo().fileName()).toStdString());
+      }
       if (!initialized) {
-        init(image);
+        init(frame);
       }
-      if (image.rows() != height || image.columns() != width) {
+      if ((uint32_t) frame.height() != height || (uint32_t) frame.width() != width) {
         throw runtime_error(QString("Not uniform image size! %").arg(info.fileInfo().fileName()).toStdString());
       }
 
-      Q_ASSERT(image.baseColumns() == width && image.baseRows() == height);
-      Magick::Blob blob;
-      // set raw RGBS output format & convert it into a Blob 
-      if (image.depth() > 8) {
-        *err << "Warning: we lost some information by converting to 8bit depth (now " << image.depth() << ")" << endl;
-      }
-      image.depth(8);
-      image.magick("RGB");
-      image.write(&blob);
-
-
-      Q_ASSERT(blob.length() == image.baseColumns() * image.baseRows() * 3);
-
       // inframe
       VSFrame inframe;
-      size_t dataLen = blob.length();
-      inframe.data[0] = static_cast<uint8_t*>(const_cast<void*>(blob.data()));
-      inframe.linesize[0] = image.baseColumns() * 3; // TODO: it is correct?
+      inframe.data[0] = const_cast<uint8_t*>(frame.constData());
+      inframe.linesize[0] = frame.stride();
 
       // outframe
-      uint8_t* data = new uint8_t[dataLen];
-      //memcpy(data, blob.data(), dataLen);
+      Frame transformed(width, height, 3, Frame::Interleaved);
       VSFrame outframe;
-      outframe.data[0] = data;
-      outframe.linesize[0] = image.baseColumns() * 3; // TODO: it is correct?
+      outframe.data[0] = transformed.data();
+      outframe.linesize[0] = transformed.stride();
 
       if (vsTransformPrepare(&td, &inframe, &outframe) != VS_OK) {
         throw runtime_error("Failed to prepare transform");
@@ -620,28 +592,17 @@ namespace timelapse {
 
       vsTransformFinish(&td);
 
-      Magick::Geometry g(width, height);
-      Magick::Blob oblob(data, dataLen);
-
-      Magick::Image oimage;
-      oimage.size(g);
-      oimage.depth(8);
-      oimage.magick("RGB");
-      oimage.read(oblob);
-
-      delete[] data;
-
       info.luminance = -1;
-      emit inputImg(info, oimage);
+      emit inputImg(info, transformed);
 
     } catch (exception &e) {
       emit error(e.what());
     }
   }
 
-  void PipelineStabTransform::init(Magick::Image img) {
-    width = img.columns();
-    height = img.rows();
+  void PipelineStabTransform::init(const Frame &frame) {
+    width = frame.width();
+    height = frame.height();
 
 
     if (!vsFrameInfoInit(&fi, width, height, PF_RGB24)) {
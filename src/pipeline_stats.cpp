@@ -0,0 +1,148 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/pipeline_stats.h>
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QJsonObject>
+
+#include <algorithm>
+#include <cmath>
+
+namespace timelapse {
+
+  namespace {
+    thread_local StageTimer *currentTimer = nullptr;
+
+    double toMs(int64_t ns) {
+      return (double) ns / 1000000.0;
+    }
+  }
+
+  int LatencyHistogram::bucket(int64_t us) {
+    if (us < SUB_BUCKETS) {
+      return std::max((int) us, 0);
+    }
+    int exponent = 63 - __builtin_clzll((unsigned long long) us);
+    int shift = exponent - SUB_BUCKET_BITS;
+    int sub = (int) ((us >> shift) & (SUB_BUCKETS - 1));
+    return std::min(SUB_BUCKETS + shift * SUB_BUCKETS + sub, BUCKETS - 1);
+  }
+
+  int64_t LatencyHistogram::bucketMiddle(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+      return bucket;
+    }
+    int shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+    int sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    int64_t lower = ((int64_t) (SUB_BUCKETS + sub)) << shift;
+    return lower + (((int64_t) 1 << shift) / 2);
+  }
+
+  void LatencyHistogram::add(int64_t ns) {
+    buckets[bucket(ns / 1000)]++;
+    total++;
+  }
+
+  int64_t LatencyHistogram::percentile(double p) const {
+    if (total == 0) {
+      return 0;
+    }
+    int64_t rank = std::max((int64_t) 1, (int64_t) std::ceil(p * total));
+    int64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen >= rank) {
+        return bucketMiddle(i) * 1000;
+      }
+    }
+    return bucketMiddle(BUCKETS - 1) * 1000;
+  }
+
+  StageStats::StageStats(const QString &name) :
+  stageName(name) {
+  }
+
+  void StageStats::onInput(int64_t _queueWaitNs, int64_t _bytes) {
+    QMutexLocker locker(&mutex);
+    framesIn++;
+    queueWaitNs += _queueWaitNs;
+    bytes += _bytes;
+  }
+
+  void StageStats::onOutput() {
+    QMutexLocker locker(&mutex);
+    framesOut++;
+  }
+
+  void StageStats::onBusy(int64_t ns) {
+    QMutexLocker locker(&mutex);
+    busyNs += ns;
+    latency.add(ns);
+  }
+
+  QString StageStats::name() const {
+    QMutexLocker locker(&mutex);
+    return stageName;
+  }
+
+  void StageStats::setName(const QString &name) {
+    QMutexLocker locker(&mutex);
+    stageName = name;
+  }
+
+  QJsonObject StageStats::toJson() const {
+    QMutexLocker locker(&mutex);
+    QJsonObject latencyObj;
+    latencyObj["p50_ms"] = toMs(latency.percentile(0.50));
+    latencyObj["p95_ms"] = toMs(latency.percentile(0.95));
+    latencyObj["p99_ms"] = toMs(latency.percentile(0.99));
+
+    QJsonObject obj;
+    obj["name"] = stageName;
+    obj["frames_in"] = (double) framesIn;
+    obj["frames_out"] = (double) framesOut;
+    obj["bytes"] = (double) bytes;
+    obj["busy_ms"] = toMs(busyNs);
+    obj["queue_wait_ms"] = toMs(queueWaitNs);
+    obj["latency"] = latencyObj;
+    return obj;
+  }
+
+  StageTimer::StageTimer(StageStats *stats) :
+  stats(stats), parent(currentTimer), start(Clock::now()) {
+    currentTimer = this;
+  }
+
+  StageTimer::~StageTimer() {
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    currentTimer = parent;
+    if (parent != nullptr) {
+      parent->nestedNs += elapsed;
+    }
+    if (stats != nullptr) {
+      stats->onBusy(std::max((int64_t) 0, elapsed - nestedNs));
+    }
+  }
+
+  int64_t StageTimer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
+
+}
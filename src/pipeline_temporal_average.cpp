@@ -0,0 +1,138 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/pipeline_temporal_average.h>
+
+#include <stdexcept>
+
+using namespace std;
+using namespace timelapse;
+
+namespace timelapse {
+
+  namespace {
+    int lineSamples(const Frame &frame) {
+      return frame.layout() == Frame::Planar ? frame.width() : frame.width() * frame.channels();
+    }
+
+    int planeCount(const Frame &frame) {
+      return frame.layout() == Frame::Planar ? frame.channels() : 1;
+    }
+
+    template<typename T>
+    void accumulate(T *sum, const Frame &add, const Frame *remove) {
+      int samples = lineSamples(add);
+      for (int p = 0; p < planeCount(add); p++) {
+        for (int y = 0; y < add.height(); y++) {
+          const uint8_t *a = add.constLine(y, p);
+          if (remove != nullptr) {
+            const uint8_t *r = remove->constLine(y, p);
+            for (int x = 0; x < samples; x++) {
+              sum[x] = sum[x] + a[x] - r[x];
+            }
+          } else {
+            for (int x = 0; x < samples; x++) {
+              sum[x] += a[x];
+            }
+          }
+          sum += samples;
+        }
+      }
+    }
+
+    template<typename T>
+    void average(const T *sum, Frame &out, uint32_t count) {
+      // fixed point reciprocal, avoids division per sample
+      const uint64_t scale = ((uint64_t(1) << 32) + count / 2) / count;
+      const uint64_t round = uint64_t(1) << 31;
+      int samples = lineSamples(out);
+      for (int p = 0; p < planeCount(out); p++) {
+        for (int y = 0; y < out.height(); y++) {
+          uint8_t *o = out.line(y, p);
+          for (int x = 0; x < samples; x++) {
+            uint64_t v = (sum[x] * scale + round) >> 32;
+            o[x] = (uint8_t) (v > 255 ? 255 : v);
+          }
+          sum += samples;
+        }
+      }
+    }
+  }
+
+  TemporalAverage::TemporalAverage(QTextStream *_verboseOutput, int _windowSize) :
+  verboseOutput(_verboseOutput), windowSize(_windowSize) {
+    if (windowSize < 1) {
+      throw std::invalid_argument("Temporal average window have to be positive!");
+    }
+  }
+
+  void TemporalAverage::reset(const Frame &frame) {
+    window.clear();
+    size_t size = (size_t) frame.width() * frame.height() * frame.channels();
+    // 16-bit accumulator holds sum of 257 samples (255 * 257 = 65535)
+    if (windowSize <= 257) {
+      sum32.clear();
+      sum16.assign(size, 0);
+    } else {
+      sum16.clear();
+      sum32.assign(size, 0);
+    }
+  }
+
+  void TemporalAverage::onInputImg(InputImageInfo info, Frame frame) {
+    if (windowSize == 1) {
+      emit inputImg(info, frame);
+      return;
+    }
+
+    if (window.isEmpty()) {
+      reset(frame);
+    } else {
+      const Frame &head = window.head();
+      if (head.width() != frame.width() || head.height() != frame.height() || head.channels() != frame.channels()) {
+        *verboseOutput << "Frame geometry changed, restarting temporal average" << endl;
+        reset(frame);
+      } else {
+        frame = frame.converted(head.layout());
+      }
+    }
+
+    Frame leaving;
+    if (window.size() == windowSize) {
+      leaving = window.dequeue();
+    }
+    window.enqueue(frame);
+
+    if (!sum16.empty()) {
+      accumulate(sum16.data(), frame, leaving.isNull() ? nullptr : &leaving);
+    } else {
+      accumulate(sum32.data(), frame, leaving.isNull() ? nullptr : &leaving);
+    }
+
+    Frame averaged = pool.acquire(frame.width(), frame.height(), frame.channels(), frame.layout());
+    if (!sum16.empty()) {
+      average(sum16.data(), averaged, window.size());
+    } else {
+      average(sum32.data(), averaged, window.size());
+    }
+    *verboseOutput << "Average of " << window.size() << " frames for " << info.fileInfo().fileName() << endl;
+    emit inputImg(info, averaged);
+  }
+
+}
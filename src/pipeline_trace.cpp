@@ -0,0 +1,167 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/pipeline_trace.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+
+#include <atomic>
+
+namespace timelapse {
+
+  namespace {
+    std::atomic<int> nextThreadId{1};
+    thread_local int threadId = 0;
+  }
+
+  TraceRecorder::TraceRecorder() :
+  start(Clock::now()) {
+  }
+
+  int64_t TraceRecorder::now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+  }
+
+  int TraceRecorder::currentThread() {
+    if (threadId == 0) {
+      threadId = nextThreadId++;
+      QThread *thread = QThread::currentThread();
+      QString name = thread->objectName();
+      if (name.isEmpty()) {
+        name = (QCoreApplication::instance() != nullptr && thread == QCoreApplication::instance()->thread()) ?
+          QString("main") : QString("thread-%1").arg(threadId);
+      }
+      QMutexLocker locker(&mutex);
+      threadNames.insert(threadId, name);
+    }
+    return threadId;
+  }
+
+  void TraceRecorder::append(Event &&event) {
+    QMutexLocker locker(&mutex);
+    events.append(std::move(event));
+  }
+
+  void TraceRecorder::span(const QString &name, int64_t ts, int64_t duration, int frame, const QString &file) {
+    int tid = currentThread();
+    append(Event{'X', name, ts, duration, tid, frame, file, QString(), 0});
+  }
+
+  void TraceRecorder::instant(const QString &name) {
+    int tid = currentThread();
+    append(Event{'i', name, now(), 0, tid, -1, QString(), QString(), 0});
+  }
+
+  void TraceRecorder::counter(const QString &name, const QString &series, int64_t value) {
+    int tid = currentThread();
+    append(Event{'C', name, now(), 0, tid, -1, QString(), series, value});
+  }
+
+  QJsonDocument TraceRecorder::toJson() const {
+    QMutexLocker locker(&mutex);
+    qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray array;
+    for (auto it = threadNames.constBegin(); it != threadNames.constEnd(); ++it) {
+      QJsonObject args;
+      args["name"] = it.value();
+      QJsonObject obj;
+      obj["ph"] = QString("M");
+      obj["name"] = QString("thread_name");
+      obj["pid"] = pid;
+      obj["tid"] = it.key();
+      obj["args"] = args;
+      array.append(obj);
+    }
+    for (const Event &e : events) {
+      QJsonObject obj;
+      obj["ph"] = QString(QChar(e.phase));
+      obj["name"] = e.name;
+      obj["pid"] = pid;
+      obj["tid"] = e.tid;
+      obj["ts"] = (double) e.ts;
+      QJsonObject args;
+      switch (e.phase) {
+        case 'X':
+          obj["dur"] = (double) e.duration;
+          if (e.frame >= 0) {
+            args["frame"] = e.frame;
+          }
+          if (!e.file.isEmpty()) {
+            args["file"] = e.file;
+          }
+          break;
+        case 'i':
+          obj["s"] = QString("t");
+          break;
+        case 'C':
+          args[e.series] = (double) e.value;
+          break;
+      }
+      obj["args"] = args;
+      array.append(obj);
+    }
+    QJsonObject root;
+    root["traceEvents"] = array;
+    root["displayTimeUnit"] = QString("ms");
+    return QJsonDocument(root);
+  }
+
+  bool TraceRecorder::write(const QString &file, QString *errorString) const {
+    QFile f(file);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      if (errorString != nullptr) {
+        *errorString = f.errorString();
+      }
+      return false;
+    }
+    QByteArray json = toJson().toJson(QJsonDocument::Compact);
+    if (f.write(json) != json.size()) {
+      if (errorString != nullptr) {
+        *errorString = f.errorString();
+      }
+      return false;
+    }
+    return true;
+  }
+
+  TraceSpan::TraceSpan(TraceRecorder *recorder, const QString &name, const InputImageInfo *info) :
+  recorder(recorder) {
+    if (recorder == nullptr) {
+      return;
+    }
+    this->name = name;
+    if (info != nullptr) {
+      frame = info->frame;
+      file = QString::fromStdString(info->filePath);
+    }
+    start = recorder->now();
+  }
+
+  TraceSpan::~TraceSpan() {
+    if (recorder != nullptr) {
+      recorder->span(name, start, recorder->now() - start, frame, file);
+    }
+  }
+
+}
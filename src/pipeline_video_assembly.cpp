@@ -27,7 +27,9 @@
 #include <QtCore/QString>
 #include <QtCore/QDir>
 #include <QtCore/QProcess>
+#include <QtCore/QFile>
 
+#include <algorithm>
 #include <cassert>
 
 using namespace std;
@@ -36,12 +38,38 @@ using namespace timelapse;
 
 namespace timelapse {
 
+  namespace {
+    /* limit of data buffered for encoder input, writer waits when it is exceeded */
+    constexpr qint64 MAX_PENDING_BYTES = 64 * 1024 * 1024;
+    /* encoders would keep full chroma of raw rgb input, that most players can't decode */
+    constexpr char DEFAULT_STREAM_PIXEL_FORMAT[] = "yuv420p";
+
+    QString detectBuilder(QTextStream *verboseOutput, QTextStream *err) {
+      QString cmd = "avconv";
+      QProcess avconv;
+      avconv.setProcessChannelMode(QProcess::MergedChannels);
+      avconv.start("avconv", QStringList() << "-version");
+      if (!avconv.waitForFinished() || avconv.exitCode() != 0) {
+        *verboseOutput << "avconv exited with error, try to use ffmpeg" << endl;
+        QProcess ffmpeg;
+        ffmpeg.setProcessChannelMode(QProcess::MergedChannels);
+        ffmpeg.start("ffmpeg", QStringList() << "-version");
+        if (!ffmpeg.waitForFinished() || ffmpeg.exitCode() != 0) {
+          *err << "Both commands (avconv, ffmpeg) fails! Try to use ffmpeg.";
+        }
+        cmd = "ffmpeg";
+      }
+      return cmd;
+    }
+  }
+
   VideoAssembly::VideoAssembly(QDir _tempDir, QTextStream *_verboseOutput, QTextStream *_err, bool _dryRun,
     QFileInfo _output, int _width, int _height, float _fps, QString _bitrate, QString _codec, QString _builderBinary,
-    QString _pixelFormat) :
+    QString _pixelFormat, bool _variableFrameRate, FrameFormat _frameFormat) :
   tempDir(_tempDir), verboseOutput(_verboseOutput), err(_err), dryRun(_dryRun),
   output(_output), width(_width), height(_height), fps(_fps), bitrate(_bitrate), codec(_codec),
-  builderBinary(_builderBinary), pixelFormat(_pixelFormat) {
+  builderBinary(_builderBinary), pixelFormat(_pixelFormat), variableFrameRate(_variableFrameRate),
+  frameFormat(_frameFormat) {
   }
 
   VideoAssembly::~VideoAssembly() {
@@ -56,6 +84,9 @@ namespace timelapse {
   }
 
   void VideoAssembly::onInput(InputImageInfo info) {
+    if (variableFrameRate) {
+      frames.append(info);
+    }
     emit input(info);
   }
 
@@ -63,22 +94,8 @@ namespace timelapse {
     if (!builderBinary.isEmpty()) {
       return builderBinary;
     }
-    QString cmd = "avconv";
-    QProcess avconv;
-    avconv.setProcessChannelMode(QProcess::MergedChannels);
-    avconv.start("avconv", QStringList() << "-version");
-    if (!avconv.waitForFinished() || avconv.exitCode() != 0) {
-      *verboseOutput << "avconv exited with error, try to use ffmpeg" << endl;
-      QProcess ffmpeg;
-      ffmpeg.setProcessChannelMode(QProcess::MergedChannels);
-      ffmpeg.start("ffmpeg", QStringList() << "-version");
-      if (!ffmpeg.waitForFinished() || ffmpeg.exitCode() != 0) {
-        *err << "Both commands (avconv, ffmpeg) fails! Try to use ffmpeg.";
-      }
-      cmd = "ffmpeg";
-    }
-    builderBinary = cmd;
-    return cmd;
+    builderBinary = detectBuilder(verboseOutput, err);
+    return builderBinary;
   }
 
   void VideoAssembly::onFinished(int exitCode, [[maybe_unused]] QProcess::ExitStatus exitStatus) {
@@ -100,22 +117,81 @@ namespace timelapse {
     *verboseOutput << ">> " << builderProc->readAll();
   }
 
-  void VideoAssembly::onLast() {
-    assert(builderProc==nullptr);
-    *verboseOutput << "Assembling video..." << endl;
-
-    QString cmd = getOrDetectBuilder();
-
+  QStringList VideoAssembly::imageSequenceArgs() {
     // avconv -f image2 -r $fps -s $res -i morphed/%06d.jpg -b:v $bitrate -c:v libx264  video.mkv
-    QStringList args = QStringList()
+    // image2 demuxer selects decoder by file suffix (mjpeg, png, ppm, pam)
+    return QStringList()
       << "-f" << "image2"
       << "-r" << QString("%1").arg(fps)
       << "-s" << QString("%1x%2").arg(width).arg(height)
-      << "-i" << (tempDir.path() + QDir::separator() + QString("%0") + QString("%1d.jpeg").arg(FRAME_FILE_LEADING_ZEROS))
+      << "-i" << (tempDir.path() + QDir::separator() + QString("%0")
+                  + QString("%1d.%2").arg(FRAME_FILE_LEADING_ZEROS).arg(frameFormat.suffix()))
       << "-b:v" << bitrate
       << "-c:v" << codec
       << "-y" // Overwrite output file without asking
       << "-r" << QString("%1").arg(fps);
+  }
+
+  QStringList VideoAssembly::concatListArgs() {
+    if (frames.isEmpty()) {
+      emit error("No frames for video assembly");
+      return QStringList();
+    }
+    // pool of frame writers may deliver frames out of order
+    std::sort(frames.begin(), frames.end(), [](const InputImageInfo &a, const InputImageInfo &b) {
+      return a.frame < b.frame;
+    });
+
+    QString listPath = tempDir.path() + QDir::separator() + QString("frames.ffconcat");
+    QString list;
+    QTextStream listStream(&list);
+    listStream << "ffconcat version 1.0" << endl;
+    auto fileEntry = [&](const InputImageInfo &info) {
+      QString path = QString::fromStdString(info.filePath);
+      listStream << "file '" << path.replace("'", "'\\''") << "'" << endl;
+    };
+    int64_t frameCount = 0;
+    for (const InputImageInfo &info : frames) {
+      int repeat = std::max(info.repeat, 1);
+      fileEntry(info);
+      listStream << "duration " << QString::number(((double) repeat) / fps, 'f', 6) << endl;
+      frameCount += repeat;
+    }
+    // concat demuxer ignores duration of the last entry, repeat it
+    fileEntry(frames.last());
+    listStream.flush();
+
+    *verboseOutput << frames.size() << " images for " << frameCount << " video frames" << endl;
+    if (!dryRun) {
+      QFile listFile(listPath);
+      if (!listFile.open(QIODevice::WriteOnly | QIODevice::Truncate)
+          || listFile.write(list.toUtf8()) < 0) {
+        emit error(QString("Failed to write frame list %1").arg(listPath));
+        return QStringList();
+      }
+    }
+
+    // ffmpeg -f concat -safe 0 -i frames.ffconcat -b:v $bitrate -c:v libx264 -vsync vfr video.mkv
+    return QStringList()
+      << "-f" << "concat"
+      << "-safe" << "0"
+      << "-i" << listPath
+      << "-b:v" << bitrate
+      << "-c:v" << codec
+      << "-y" // Overwrite output file without asking
+      << "-vsync" << "vfr";
+  }
+
+  void VideoAssembly::onLast() {
+    assert(builderProc==nullptr);
+    *verboseOutput << "Assembling video..." << endl;
+
+    QString cmd = getOrDetectBuilder();
+    QStringList args = variableFrameRate ? concatListArgs() : imageSequenceArgs();
+    if (args.isEmpty()) {
+      emit last();
+      return;
+    }
 
     if (!pixelFormat.isEmpty()) {
       args << "-pix_fmt" << pixelFormat;
@@ -139,5 +215,164 @@ namespace timelapse {
     }
   }
 
-}
+  StreamingVideoAssembly::StreamingVideoAssembly(QTextStream *_verboseOutput, QTextStream *_err, bool _dryRun,
+    QFileInfo _output, float _fps, QString _bitrate, QString _codec, QString _builderBinary,
+    QString _pixelFormat) :
+  verboseOutput(_verboseOutput), err(_err), dryRun(_dryRun),
+  output(_output), fps(_fps), bitrate(_bitrate), codec(_codec),
+  builderBinary(_builderBinary), pixelFormat(_pixelFormat) {
+  }
+
+  StreamingVideoAssembly::~StreamingVideoAssembly() {
+    if (builderProc != nullptr) {
+      builderProc->terminate();
+      builderProc->waitForFinished(-1 /* no timeout */);
+      delete builderProc;
+      builderProc = nullptr;
+    }
+  }
+
+  bool StreamingVideoAssembly::startBuilder(const Frame &frame) {
+    width = frame.width();
+    height = frame.height();
+    channels = frame.channels();
+    QString inputFormat;
+    switch (channels) {
+      case 1: inputFormat = "gray"; break;
+      case 3: inputFormat = "rgb24"; break;
+      case 4: inputFormat = "rgba"; break;
+      default:
+        emit error(QString("Unsupported channel count %1 of video frame").arg(channels));
+        return false;
+    }
+
+    if (builderBinary.isEmpty()) {
+      builderBinary = detectBuilder(verboseOutput, err);
+    }
 
+    // ffmpeg -f rawvideo -pix_fmt rgb24 -s $res -r $fps -i - -b:v $bitrate -c:v libx264 video.mkv
+    QStringList args = QStringList()
+      << "-f" << "rawvideo"
+      << "-pix_fmt" << inputFormat
+      << "-s" << QString("%1x%2").arg(width).arg(height)
+      << "-r" << QString("%1").arg(fps)
+      << "-i" << "-"
+      << "-b:v" << bitrate
+      << "-c:v" << codec
+      << "-y" // Overwrite output file without asking
+      << "-r" << QString("%1").arg(fps);
+
+    args << "-pix_fmt" << (pixelFormat.isEmpty() ? QString(DEFAULT_STREAM_PIXEL_FORMAT) : pixelFormat);
+
+    args << output.filePath();
+
+    *verboseOutput << "Executing:" << endl << builderBinary << " " << args.join(' ') << endl;
+    if (dryRun) {
+      return true;
+    }
+    builderProc = new QProcess();
+    builderProc->setProcessChannelMode(QProcess::MergedChannels);
+    connect(builderProc, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(onFinished(int, QProcess::ExitStatus)));
+    connect(builderProc, &QProcess::readyReadStandardOutput, this, &StreamingVideoAssembly::onStdoutReady);
+    builderProc->start(builderBinary, args);
+    if (!builderProc->waitForStarted()) {
+      emit error(QString("Failed to start video builder %1: %2").arg(builderBinary).arg(builderProc->errorString()));
+      return false;
+    }
+    return true;
+  }
+
+  bool StreamingVideoAssembly::writeFrame(const Frame &frame, int repeat) {
+    if (frame.width() != width || frame.height() != height || frame.channels() != channels) {
+      emit error(QString("Frame %1x%2 doesn't match video resolution %3x%4")
+        .arg(frame.width()).arg(frame.height()).arg(width).arg(height));
+      return false;
+    }
+    if (dryRun) {
+      return true;
+    }
+    // repeated frame is converted once and just written multiple times
+    Frame interleaved = frame.converted(Frame::Interleaved);
+    qint64 lineBytes = (qint64) width * channels;
+    for (int r = 0; r < repeat; r++) {
+      for (int y = 0; y < height; y++) {
+        if (builderProc->write(reinterpret_cast<const char*>(interleaved.constLine(y)), lineBytes) != lineBytes) {
+          emit error(QString("Failed to write frame to video builder: %1").arg(builderProc->errorString()));
+          return false;
+        }
+      }
+      // don't buffer whole video in memory when encoder is slower than processing
+      while (builderProc->bytesToWrite() > MAX_PENDING_BYTES) {
+        if (!builderProc->waitForBytesWritten(-1)) {
+          emit error(QString("Failed to write frame to video builder: %1").arg(builderProc->errorString()));
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  void StreamingVideoAssembly::onInputImg(InputImageInfo info, Frame frame) {
+    if (!failed) {
+      if (frameCount == 0 && builderProc == nullptr) {
+        failed = !startBuilder(frame);
+      }
+      if (!failed) {
+        failed = !writeFrame(frame, std::max(info.repeat, 1));
+      }
+      if (!failed) {
+        frameCount += std::max(info.repeat, 1);
+      }
+    }
+    emit inputImg(info, frame);
+  }
+
+  void StreamingVideoAssembly::onFinished(int exitCode, QProcess::ExitStatus exitStatus) {
+    assert(builderProc != nullptr);
+
+    *verboseOutput << ">> " << builderProc->readAll();
+    builderProc->deleteLater();
+    builderProc = nullptr;
+
+    QString failure;
+    if (exitStatus == QProcess::CrashExit) {
+      failure = "Video builder crashed";
+    } else if (exitCode != 0) {
+      failure = QString("Video builder exited with %1").arg(exitCode);
+    } else if (!lastReceived) {
+      failure = "Video builder exited";
+    }
+    if (!lastReceived) {
+      // encoder is not running anymore, following frames are dropped
+      failed = true;
+      failure += " before all frames were written";
+    }
+    if (!failure.isEmpty()) {
+      emit error(failure);
+    }
+    if (lastReceived) {
+      emit last();
+    }
+  }
+
+  void StreamingVideoAssembly::onStdoutReady() {
+    assert(builderProc != nullptr);
+    *verboseOutput << ">> " << builderProc->readAll();
+  }
+
+  void StreamingVideoAssembly::onLast() {
+    *verboseOutput << "Finishing video, " << frameCount << " frames written..." << endl;
+    lastReceived = true;
+    if (builderProc == nullptr) {
+      if (frameCount == 0 && !dryRun) {
+        emit error("No frames for video");
+      }
+      emit last();
+      return;
+    }
+    // encoder finishes when input is closed, last is emitted from onFinished
+    builderProc->closeWriteChannel();
+  }
+
+}
@@ -0,0 +1,273 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/pipeline_watch_source.h>
+#include <TimeLapse/pipeline_source.h>
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTextStream>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace timelapse {
+
+  PipelineWatchSource::PipelineWatchSource(const QString &_directory, const QStringList &_fileSuffixes,
+    int64_t _quiescenceMs, const QString &_sentinel,
+    QTextStream *_verboseOutput, QTextStream *_err) :
+  directory(_directory),
+  fileSuffixes(_fileSuffixes.isEmpty() ? PipelineFileSource::imageSuffixes() : _fileSuffixes),
+  quiescenceMs(_quiescenceMs), sentinel(_sentinel),
+  verboseOutput(_verboseOutput), err(_err) {
+
+    connect(this, &PipelineWatchSource::processNext, this, &PipelineWatchSource::takeNext, Qt::QueuedConnection);
+  }
+
+  PipelineWatchSource::~PipelineWatchSource() {
+    stopWatching();
+  }
+
+  void PipelineWatchSource::onInput([[maybe_unused]] InputImageInfo info) {
+    // just ignore, we are the source
+  }
+
+  void PipelineWatchSource::setFlowControl(FlowControl *_flowControl) {
+    flowControl = _flowControl;
+    connect(flowControl, &FlowControl::released, this, &PipelineWatchSource::onCreditReleased, Qt::QueuedConnection);
+  }
+
+  void PipelineWatchSource::setSequenceIndex(SequenceIndex *index) {
+    sequenceIndex = index;
+  }
+
+  bool PipelineWatchSource::acceptFile(const QString &name) const {
+    // hidden files are used as temporary files by some writers
+    if (name.startsWith(".")) {
+      return false;
+    }
+    // last suffix, "IMG_0001.JPG.tmp" is temporary file
+    return fileSuffixes.contains(QFileInfo(name).suffix(), Qt::CaseInsensitive);
+  }
+
+  void PipelineWatchSource::process() {
+#ifdef __linux__
+    if (!directory.exists()) {
+      emit error(QString("Can't find input directory %1").arg(directory.path()));
+      return;
+    }
+
+    // start watching before listing, files completed meanwhile are deduplicated
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0 ||
+        inotify_add_watch(inotifyFd, QFile::encodeName(directory.path()).constData(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      emit error(QString("Can't watch directory %1: %2").arg(directory.path()).arg(std::strerror(errno)));
+      stopWatching();
+      return;
+    }
+    notifier = new QSocketNotifier(inotifyFd, QSocketNotifier::Read, this);
+    // string based connection, activated signal is overloaded since Qt 5.15
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(onNotification()));
+
+    *verboseOutput << "Watching directory: " << directory.path() << endl;
+    QDateTime settled = QDateTime::currentDateTime().addMSecs(-WATCH_SETTLE_MS);
+    for (const QFileInfo &file : directory.entryInfoList(QDir::Files, QDir::Name)) {
+      if (!sentinel.isEmpty() && file.fileName() == sentinel) {
+        finished = true;
+      } else if (acceptFile(file.fileName())) {
+        if (file.lastModified() > settled) {
+          // camera or rsync may be still writing it, wait for close
+          settling.insert(file.fileName());
+        } else {
+          enqueue(file.fileName());
+        }
+      }
+    }
+    *verboseOutput << "...found " << (queue.size() + settling.size()) << " existing images, "
+      << settling.size() << " of them may be still written" << endl;
+
+    if (finished) {
+      *verboseOutput << "Sentinel file " << sentinel << " exists already" << endl;
+      finish();
+    } else if (!settling.isEmpty()) {
+      settleTimer = new QTimer(this);
+      settleTimer->setInterval(WATCH_SETTLE_MS / 4);
+      connect(settleTimer, &QTimer::timeout, this, &PipelineWatchSource::onSettleTimeout);
+      settleTimer->start();
+    }
+    if (!finished && quiescenceMs > 0) {
+      quiescenceTimer = new QTimer(this);
+      quiescenceTimer->setSingleShot(true);
+      quiescenceTimer->setInterval(quiescenceMs);
+      connect(quiescenceTimer, &QTimer::timeout, this, &PipelineWatchSource::onQuiescence);
+      quiescenceTimer->start();
+    }
+    schedule();
+#else
+    emit error("Watching of directory is supported just on Linux");
+#endif
+  }
+
+  void PipelineWatchSource::onNotification() {
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    for (;;) {
+      ssize_t len = read(inotifyFd, buffer, sizeof(buffer));
+      if (len <= 0) {
+        break;
+      }
+      for (ssize_t offset = 0; offset < len;) {
+        const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+          *err << "Too many changes in " << directory.path() << ", some images may be missed" << endl;
+          continue;
+        }
+        if (event->len == 0 || finished) {
+          continue;
+        }
+        QString name = QFile::decodeName(event->name);
+        if (!sentinel.isEmpty() && name == sentinel) {
+          *verboseOutput << "Sentinel file " << sentinel << " found" << endl;
+          finish();
+        } else if (acceptFile(name)) {
+          settling.remove(name);
+          enqueue(name);
+          if (quiescenceTimer != nullptr) {
+            quiescenceTimer->start();
+          }
+        }
+      }
+    }
+    schedule();
+#endif
+  }
+
+  void PipelineWatchSource::onQuiescence() {
+    *verboseOutput << "No new image for " << (quiescenceMs / 1000) << " s, finishing" << endl;
+    finish();
+    schedule();
+  }
+
+  void PipelineWatchSource::onSettleTimeout() {
+    enqueueSettled(false);
+    schedule();
+  }
+
+  void PipelineWatchSource::enqueueSettled(bool force) {
+    QDateTime settled = QDateTime::currentDateTime().addMSecs(-WATCH_SETTLE_MS);
+    QStringList names = settling.values();
+    names.sort();
+    for (const QString &name : names) {
+      QFileInfo file(directory, name);
+      if (!file.exists()) {
+        // temporary file renamed or removed by the writer
+        settling.remove(name);
+      } else if (force || file.lastModified() <= settled) {
+        enqueue(name);
+        settling.remove(name);
+      }
+    }
+    if (settling.isEmpty() && settleTimer != nullptr) {
+      settleTimer->stop();
+    }
+  }
+
+  void PipelineWatchSource::enqueue(const QString &name) {
+    if (seen.contains(name)) {
+      // file rewritten or reported by listing and by notification
+      return;
+    }
+    seen.insert(name);
+    InputImageInfo info(QFileInfo(directory, name));
+    if (sequenceIndex != nullptr) {
+      sequenceIndex->lookup(info);
+    }
+    queue.enqueue(info);
+  }
+
+  void PipelineWatchSource::finish() {
+    finished = true;
+    // writing is done
+    enqueueSettled(true);
+    stopWatching();
+  }
+
+  void PipelineWatchSource::stopWatching() {
+    if (quiescenceTimer != nullptr) {
+      quiescenceTimer->stop();
+    }
+    if (settleTimer != nullptr) {
+      settleTimer->stop();
+    }
+    if (notifier != nullptr) {
+      notifier->setEnabled(false);
+      notifier->deleteLater();
+      notifier = nullptr;
+    }
+#ifdef __linux__
+    if (inotifyFd >= 0) {
+      close(inotifyFd);
+      inotifyFd = -1;
+    }
+#endif
+  }
+
+  void PipelineWatchSource::schedule() {
+    if (!scheduled && !waitingForCredit) {
+      scheduled = true;
+      emit processNext();
+    }
+  }
+
+  void PipelineWatchSource::onCreditReleased() {
+    if (waitingForCredit) {
+      waitingForCredit = false;
+      schedule();
+    }
+  }
+
+  void PipelineWatchSource::takeNext() {
+    scheduled = false;
+    if (queue.isEmpty()) {
+      if (finished && !lastEmitted) {
+        lastEmitted = true;
+        emit last();
+      }
+      // otherwise wait for notification
+      return;
+    }
+    InputImageInfo &info = queue.head();
+    if (flowControl != nullptr) {
+      info.credit = flowControl->tryAcquire();
+      if (info.credit < 0) {
+        // wait until downstream stages release some credit
+        waitingForCredit = true;
+        return;
+      }
+    }
+    emit input(queue.dequeue());
+    schedule();
+  }
+}
@@ -0,0 +1,214 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/pipeline_worker_pool.h>
+#include <TimeLapse/queued_output_device.h>
+
+#include <QtCore/QMutexLocker>
+
+#include <exception>
+
+namespace timelapse {
+
+  ImageHandlerPool::ImageHandlerPool(int workerCount, ImageHandlerFactory factory,
+    QTextStream *verboseOutput, QTextStream *err) :
+  capacity(workerCount * 2) {
+
+    if (workerCount < 1) {
+      throw std::invalid_argument("Worker count have to be positive!");
+    }
+
+    for (int i = 0; i < workerCount; i++) {
+      Worker *worker = new Worker();
+      // every worker writes to own stream, output is serialized in the pool thread
+      QueuedOutputDevice *verboseDevice = new QueuedOutputDevice(verboseOutput, this);
+      verboseDevice->setParent(this);
+      QueuedOutputDevice *errDevice = new QueuedOutputDevice(err, this);
+      errDevice->setParent(this);
+      worker->verboseOutput = new QTextStream(verboseDevice);
+      worker->err = new QTextStream(errDevice);
+
+      worker->handler = factory(worker->verboseOutput, worker->err);
+      worker->thread = new QThread();
+      worker->thread->setObjectName(QString("%1-%2")
+        .arg(worker->handler->metaObject()->className())
+        .arg(i));
+      worker->handler->moveToThread(worker->thread);
+
+      connect(worker->handler, &ImageHandler::inputImg, worker->handler,
+        [this, worker](InputImageInfo info, Frame frame) {
+          onWorkerOutput(worker, info, frame);
+        }, Qt::DirectConnection);
+      connect(worker->handler, &PipelineHandler::error, this, &PipelineHandler::error);
+
+      worker->thread->start();
+      workers.append(worker);
+      idle.append(worker);
+    }
+    setObjectName(QString("%1 x%2")
+      .arg(workers.first()->handler->metaObject()->className())
+      .arg(workerCount));
+  }
+
+  void ImageHandlerPool::setStats(StageStats *_stats) {
+    stats = _stats;
+  }
+
+  void ImageHandlerPool::setTrace(TraceRecorder *_trace) {
+    trace = _trace;
+  }
+
+  void ImageHandlerPool::forEachHandler(std::function<void(ImageHandler*)> function) {
+    for (Worker *worker : workers) {
+      function(worker->handler);
+    }
+  }
+
+  void ImageHandlerPool::stopWorkers(const QList<QThread*> &targets) {
+    if (targets.size() != workers.size()) {
+      throw std::invalid_argument("Target thread count have to match worker count!");
+    }
+    for (int i = 0; i < workers.size(); i++) {
+      Worker *worker = workers[i];
+      QThread *target = targets[i];
+      // object may be pushed to another thread just from its current thread
+      QMetaObject::invokeMethod(worker->handler, [worker, target]() {
+        worker->handler->moveToThread(target);
+      }, Qt::BlockingQueuedConnection);
+      worker->thread->quit();
+      worker->thread->wait();
+    }
+  }
+
+  bool ImageHandlerPool::scaleInvariant() const {
+    return workers.first()->handler->scaleInvariant();
+  }
+
+  QSize ImageHandlerPool::outputSize() const {
+    return workers.first()->handler->outputSize();
+  }
+
+  bool ImageHandlerPool::pixelsRequired(const InputImageInfo &info) const {
+    return workers.first()->handler->pixelsRequired(info);
+  }
+
+  ImageHandlerPool::~ImageHandlerPool() {
+    for (Worker *worker : workers) {
+      worker->thread->quit();
+    }
+    for (Worker *worker : workers) {
+      worker->thread->wait();
+      delete worker->handler;
+      delete worker->thread;
+      worker->verboseOutput->flush();
+      worker->err->flush();
+      delete worker->verboseOutput;
+      delete worker->err;
+      delete worker;
+    }
+  }
+
+  void ImageHandlerPool::onInput(InputImageInfo info) {
+    onInputImg(info, Frame());
+  }
+
+  void ImageHandlerPool::onInputImg(InputImageInfo info, Frame frame) {
+    Worker *worker = nullptr;
+    qint64 sequence;
+    for (;;) {
+      drain();
+      QMutexLocker locker(&mutex);
+      if (!idle.isEmpty() && (nextSequence - nextEmit) < capacity) {
+        worker = idle.takeFirst();
+        sequence = nextSequence++;
+        results.insert(sequence, Result());
+        break;
+      }
+      if (!headDone()) {
+        condition.wait(&mutex);
+      }
+    }
+
+    QMetaObject::invokeMethod(worker->handler, [this, worker, sequence, info, frame]() {
+      worker->sequence = sequence;
+      {
+        TraceSpan span(trace, objectName(), &info);
+        StageTimer timer(stats);
+        worker->handler->onInputImg(info, frame);
+      }
+      onWorkerDone(worker, sequence);
+    }, Qt::QueuedConnection);
+  }
+
+  void ImageHandlerPool::onWorkerOutput(Worker *worker, InputImageInfo info, Frame frame) {
+    QMutexLocker locker(&mutex);
+    results[worker->sequence].outputs.append(qMakePair(info, frame));
+  }
+
+  void ImageHandlerPool::onWorkerDone(Worker *worker, qint64 sequence) {
+    {
+      QMutexLocker locker(&mutex);
+      results[sequence].done = true;
+      idle.append(worker);
+      condition.wakeAll();
+    }
+    QMetaObject::invokeMethod(this, [this]() {
+      drain();
+    }, Qt::QueuedConnection);
+  }
+
+  bool ImageHandlerPool::headDone() const {
+    auto it = results.constFind(nextEmit);
+    return it != results.constEnd() && it->done;
+  }
+
+  void ImageHandlerPool::drain() {
+    for (;;) {
+      QList<QPair<InputImageInfo, Frame>> outputs;
+      {
+        QMutexLocker locker(&mutex);
+        if (!headDone()) {
+          return;
+        }
+        outputs = results.take(nextEmit).outputs;
+        nextEmit++;
+        condition.wakeAll();
+      }
+      // emit outside of the lock, downstream stage may block us
+      for (const auto &output : outputs) {
+        emit inputImg(output.first, output.second);
+      }
+    }
+  }
+
+  void ImageHandlerPool::onLast() {
+    for (;;) {
+      drain();
+      QMutexLocker locker(&mutex);
+      if (nextEmit == nextSequence) {
+        break;
+      }
+      if (!headDone()) {
+        condition.wait(&mutex);
+      }
+    }
+    emit last();
+  }
+
+}
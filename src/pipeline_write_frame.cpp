@@ -27,6 +27,16 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QString>
 #include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QRunnable>
+
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace timelapse;
@@ -34,9 +44,151 @@ using namespace timelapse;
 
 namespace timelapse {
 
-  WriteFrame::WriteFrame(QDir _outputDir, QTextStream *_verboseOutput, bool _dryRun) :
+  FrameFormat FrameFormat::parse(const QString &spec, bool *ok) {
+    FrameFormat format;
+    *ok = false;
+    QStringList parts = spec.toLower().split(':');
+    QString type = parts.takeFirst();
+    if (type == "ppm" || type == "pam") {
+      format.type = (type == "ppm") ? Ppm : Pam;
+      *ok = parts.isEmpty();
+    } else if (type == "png") {
+      format.type = Png;
+      if (parts.isEmpty()) {
+        *ok = true;
+      } else if (parts.size() == 1) {
+        format.quality = parts[0].toInt(ok);
+        *ok = *ok && format.quality >= 0 && format.quality <= 9;
+      }
+    } else if (type == "jpeg" || type == "jpg") {
+      format.type = Jpeg;
+      *ok = parts.size() <= 2;
+      if (*ok && !parts.isEmpty()) {
+        format.quality = parts[0].toInt(ok);
+        *ok = *ok && format.quality >= 1 && format.quality <= 100;
+      }
+      if (*ok && parts.size() == 2) {
+        if (parts[1] == "420") {
+          format.samplingFactor = "2x2";
+        } else if (parts[1] == "422") {
+          format.samplingFactor = "2x1";
+        } else if (parts[1] == "444") {
+          format.samplingFactor = "1x1";
+        } else {
+          *ok = false;
+        }
+      }
+    }
+    return format;
+  }
+
+  QString FrameFormat::suffix() const {
+    switch (type) {
+      case Png: return "png";
+      case Ppm: return "ppm";
+      case Pam: return "pam";
+      case Jpeg:
+      default:
+        return "jpeg";
+    }
+  }
+
+  namespace {
+    QByteArray encodeNetpbm(const Frame &frame, FrameFormat::Type type) {
+      Frame interleaved = frame.converted(Frame::Interleaved);
+      int width = interleaved.width();
+      int height = interleaved.height();
+      int channels = interleaved.channels();
+
+      QByteArray data;
+      int outChannels = channels;
+      if (type == FrameFormat::Pam) {
+        const char *tupleType = channels == 1 ? "GRAYSCALE" : (channels == 4 ? "RGB_ALPHA" : "RGB");
+        data = QString("P7\nWIDTH %1\nHEIGHT %2\nDEPTH %3\nMAXVAL 255\nTUPLTYPE %4\nENDHDR\n")
+          .arg(width).arg(height).arg(channels).arg(tupleType).toLatin1();
+      } else {
+        // PPM doesn't support alpha channel, it is dropped
+        outChannels = channels == 1 ? 1 : 3;
+        data = QString("%1\n%2 %3\n255\n")
+          .arg(channels == 1 ? "P5" : "P6").arg(width).arg(height).toLatin1();
+      }
+
+      int headerSize = data.size();
+      data.resize(headerSize + width * height * outChannels);
+      uint8_t *dst = reinterpret_cast<uint8_t*>(data.data()) + headerSize;
+      for (int y = 0; y < height; y++) {
+        const uint8_t *src = interleaved.constLine(y);
+        if (outChannels == channels) {
+          memcpy(dst, src, width * channels);
+        } else {
+          for (int x = 0; x < width; x++) {
+            dst[x * 3 + 0] = src[x * channels + 0];
+            dst[x * 3 + 1] = src[x * channels + 1];
+            dst[x * 3 + 2] = src[x * channels + 2];
+          }
+        }
+        dst += width * outChannels;
+      }
+      return data;
+    }
+
+    class EncodeTask : public QRunnable {
+    public:
+      EncodeTask(Frame frame, FrameFormat format, std::function<void(const QByteArray&, const QString&)> done) :
+      frame(frame), format(format), done(done) {
+        setAutoDelete(true);
+      }
+
+      void run() override {
+        QByteArray data;
+        QString error;
+        try {
+          data = format.encode(frame);
+        } catch (const std::exception &e) {
+          error = QString::fromUtf8(e.what());
+        }
+        frame = Frame();
+        done(data, error);
+      }
+
+    private:
+      Frame frame;
+      FrameFormat format;
+      std::function<void(const QByteArray&, const QString&)> done;
+    };
+  }
+
+  QByteArray FrameFormat::encode(const Frame &frame) const {
+    if (type == Ppm || type == Pam) {
+      // raw formats are written directly from frame buffer
+      return encodeNetpbm(frame, type);
+    }
+    Magick::Image img = frame.toImage();
+    if (type == Png) {
+      img.magick("PNG");
+      if (quality >= 0) {
+        // ImageMagick PNG quality is zlib level * 10 + filter type, 5 is adaptive filtering
+        img.quality(quality * 10 + 5);
+      }
+    } else {
+      img.compressType(Magick::JPEGCompression);
+      img.magick("JPEG");
+      if (quality > 0) {
+        img.quality(quality);
+      }
+      if (!samplingFactor.isEmpty()) {
+        img.samplingFactor(samplingFactor.toStdString());
+      }
+    }
+    Magick::Blob blob;
+    img.write(&blob);
+    return QByteArray(static_cast<const char*>(blob.data()), blob.length());
+  }
+
+  WriteFrame::WriteFrame(QDir _outputDir, QTextStream *_verboseOutput, bool _dryRun, bool _repeatFrames,
+                         FrameFormat _format) :
   outputDir(_outputDir), frameNumberLocale(QLocale::c()),
-  verboseOutput(_verboseOutput), dryRun(_dryRun) {
+  verboseOutput(_verboseOutput), dryRun(_dryRun), repeatFrames(_repeatFrames), format(_format) {
 
     frameNumberLocale.setNumberOptions(QLocale::OmitGroupSeparator);
   }
@@ -50,24 +202,167 @@ namespace timelapse {
     return s.prepend(QString(leadingZeros - s.length(), '0'));
   }
 
-  void WriteFrame::onInputImg(InputImageInfo info, Magick::Image img) {
-    QString framePath = outputDir.path() + QDir::separator()
-      + leadingZeros(info.frame, FRAME_FILE_LEADING_ZEROS) + QString(".jpeg");
+  QString WriteFrame::framePath(int frame) {
+    return outputDir.path() + QDir::separator()
+      + leadingZeros(frame, FRAME_FILE_LEADING_ZEROS) + QString(".") + format.suffix();
+  }
+
+  void WriteFrame::writeImage(const Frame &frame, const QString &path) {
+    QByteArray data = format.encode(frame);
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size()) {
+      emit error(QString("Failed to write frame %1: %2").arg(path).arg(file.errorString()));
+    }
+  }
+
+  void WriteFrame::onInputImg(InputImageInfo info, Frame frame) {
+    QString path = framePath(info.frame);
 
     {
-      ScopeLogger loadLogger(verboseOutput, QString("Writing frame %1").arg(framePath));
+      ScopeLogger loadLogger(verboseOutput, QString("Writing frame %1").arg(path));
       if (!dryRun) {
-        img.compressType(Magick::JPEGCompression);
-        img.magick("JPEG");
-        img.write(framePath.toStdString());
+        writeImage(frame, path);
+      }
+    }
+    if (repeatFrames && info.repeat > 1) {
+      *verboseOutput << "Repeat frame " << info.frame << " " << info.repeat << " times" << endl;
+      if (!dryRun) {
+        for (int f = info.frame + 1; f < info.frame + info.repeat; f++) {
+          repeatFrame(path, framePath(f));
+        }
       }
     }
     // update image location & emit signal
-    info.filePath = framePath.toStdString();
-    emit inputImg(info, img);
+    info.filePath = path.toStdString();
+    emit inputImg(info, frame);
   }
 
-}
+  AsyncWriteFrame::AsyncWriteFrame(QDir _outputDir, QTextStream *_verboseOutput, QTextStream *_err, bool _dryRun,
+                                   bool _repeatFrames, FrameFormat _format, int threads) :
+  WriteFrame(_outputDir, _verboseOutput, _dryRun, _repeatFrames, _format),
+  err(_err), encoders(new QThreadPool()), writer(new AsyncFileWriter(threads, this)),
+  maxPendingWrites(threads * 4) {
+    if (threads <= 0) {
+      throw std::invalid_argument("Writer thread count have to be positive!");
+    }
+    encoders->setMaxThreadCount(threads);
+    connect(writer, &AsyncFileWriter::written, this, &AsyncWriteFrame::onWritten);
+  }
+
+  AsyncWriteFrame::~AsyncWriteFrame() {
+    encoders->waitForDone();
+    delete encoders;
+  }
+
+  void AsyncWriteFrame::onInputImg(InputImageInfo info, Frame frame) {
+    QSharedPointer<Entry> entry(new Entry());
+    entry->info = info;
+    entry->frame = frame;
+    entry->path = framePath(info.frame);
+    {
+      QMutexLocker locker(&mutex);
+      queue.append(entry);
+    }
+    if (dryRun) {
+      entry->done = true;
+      drain();
+      return;
+    }
+
+    encoders->start(new EncodeTask(frame, format, [this, entry](const QByteArray &data, const QString &error) {
+      {
+        QMutexLocker locker(&mutex);
+        entry->data = data;
+        entry->error = error;
+        entry->done = true;
+        encoded.wakeAll();
+      }
+      QMetaObject::invokeMethod(this, [this]() {
+        drain();
+      }, Qt::QueuedConnection);
+    }));
+
+    // don't buffer frames without limit when disk is slower than processing,
+    // wait until head of the queue is encoded and the writer accepts it
+    for (;;) {
+      {
+        QMutexLocker locker(&mutex);
+        if (queue.size() < maxPendingWrites) {
+          break;
+        }
+        while (!queue.first()->done) {
+          encoded.wait(&mutex);
+        }
+      }
+      if (writer->pending() >= maxPendingWrites) {
+        writer->waitForWritten();
+      }
+      drain();
+    }
+  }
 
+  void AsyncWriteFrame::drain() {
+    for (;;) {
+      QSharedPointer<Entry> head;
+      {
+        QMutexLocker locker(&mutex);
+        if (queue.isEmpty() || !queue.first()->done) {
+          break;
+        }
+        if (writer->pending() >= maxPendingWrites) {
+          // disk is slower than processing, continue when some write is finished
+          break;
+        }
+        head = queue.takeFirst();
+      }
+      InputImageInfo info = head->info;
+      if (!head->error.isEmpty()) {
+        *err << "Failed to encode frame " << head->path << ": " << head->error << endl;
+        emit error(QString("Failed to encode frame %1: %2").arg(head->path).arg(head->error));
+      } else if (dryRun) {
+        *verboseOutput << "Writing frame " << head->path << endl;
+      } else {
+        *verboseOutput << "Queue frame " << head->path << " (" << head->data.size() << " bytes)" << endl;
+        uint64_t id = writer->write(head->path, head->data);
+        writes.insert(id, info);
+      }
+      // update image location & emit signal
+      info.filePath = head->path.toStdString();
+      emit inputImg(info, head->frame);
+    }
+    checkLast();
+  }
 
+  void AsyncWriteFrame::onWritten(uint64_t id, QString path, QString errorString) {
+    InputImageInfo info = writes.take(id);
+    if (!errorString.isEmpty()) {
+      *err << "Failed to write frame " << path << ": " << errorString << endl;
+      emit error(QString("Failed to write frame %1: %2").arg(path).arg(errorString));
+    } else if (repeatFrames && info.repeat > 1) {
+      *verboseOutput << "Repeat frame " << info.frame << " " << info.repeat << " times" << endl;
+      for (int f = info.frame + 1; f < info.frame + info.repeat; f++) {
+        repeatFrame(path, framePath(f));
+      }
+    }
+    drain();
+  }
 
+  void AsyncWriteFrame::checkLast() {
+    bool empty;
+    {
+      QMutexLocker locker(&mutex);
+      empty = queue.isEmpty();
+    }
+    if (lastReceived && empty && writer->pending() == 0) {
+      lastReceived = false;
+      emit last();
+    }
+  }
+
+  void AsyncWriteFrame::onLast() {
+    // last is emitted when all frames are written
+    lastReceived = true;
+    drain();
+  }
+
+}
@@ -0,0 +1,47 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/queued_output_device.h>
+
+#include <QtCore/QString>
+
+namespace timelapse {
+
+  QueuedOutputDevice::QueuedOutputDevice(QTextStream *target, QObject *context) :
+  QIODevice(), target(target), context(context) {
+    open(WriteOnly);
+  }
+
+  QueuedOutputDevice::~QueuedOutputDevice() {
+  }
+
+  qint64 QueuedOutputDevice::readData([[maybe_unused]] char *data, [[maybe_unused]] qint64 maxlen) {
+    return -1;
+  }
+
+  qint64 QueuedOutputDevice::writeData(const char *data, qint64 len) {
+    QString str = QString::fromUtf8(data, len);
+    QTextStream *out = target;
+    QMetaObject::invokeMethod(context, [out, str]() {
+      *out << str;
+      out->flush();
+    }, Qt::QueuedConnection);
+    return len;
+  }
+}
@@ -0,0 +1,291 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/resampler.h>
+
+#include <QtCore/QRunnable>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+using namespace timelapse;
+
+namespace timelapse {
+
+  namespace {
+    constexpr int WEIGHT_BITS = 14;
+    constexpr int32_t WEIGHT_ONE = 1 << WEIGHT_BITS;
+    constexpr int32_t WEIGHT_ROUND = 1 << (WEIGHT_BITS - 1);
+    /* rows processed by one thread at least, smaller frames are not split */
+    constexpr int MIN_ROWS_PER_THREAD = 32;
+
+    double sinc(double x) {
+      if (x == 0.0) {
+        return 1.0;
+      }
+      x *= M_PI;
+      return std::sin(x) / x;
+    }
+
+    double filterSupport(Resampler::Filter filter) {
+      switch (filter) {
+        case Resampler::Box: return 0.5;
+        case Resampler::Bilinear: return 1.0;
+        case Resampler::Lanczos3:
+        default:
+          return 3.0;
+      }
+    }
+
+    double filterValue(Resampler::Filter filter, double x) {
+      switch (filter) {
+        case Resampler::Box:
+          return (x > -0.5 && x <= 0.5) ? 1.0 : 0.0;
+        case Resampler::Bilinear:
+          x = std::fabs(x);
+          return x < 1.0 ? 1.0 - x : 0.0;
+        case Resampler::Lanczos3:
+        default:
+          return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+      }
+    }
+
+    inline uint8_t clamp8(int32_t v) {
+      v >>= WEIGHT_BITS;
+      return (uint8_t) (v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+
+    template<int C>
+    void horizontalLine(const uint8_t *src, uint8_t *dst, int dstWidth, int taps,
+                        const int *start, const int *count, const int16_t *weights) {
+      for (int x = 0; x < dstWidth; x++) {
+        int32_t acc[C];
+        for (int c = 0; c < C; c++) {
+          acc[c] = WEIGHT_ROUND;
+        }
+        const uint8_t *s = src + start[x] * C;
+        const int16_t *k = weights + x * taps;
+        for (int t = 0; t < count[x]; t++) {
+          for (int c = 0; c < C; c++) {
+            acc[c] += s[t * C + c] * k[t];
+          }
+        }
+        for (int c = 0; c < C; c++) {
+          dst[x * C + c] = clamp8(acc[c]);
+        }
+      }
+    }
+
+    class PassTask : public QRunnable {
+    public:
+      PassTask(const std::function<void(int, int)> &pass, int y0, int y1) :
+      pass(pass), y0(y0), y1(y1) {
+        setAutoDelete(true);
+      }
+
+      void run() override {
+        pass(y0, y1);
+      }
+
+    private:
+      const std::function<void(int, int)> &pass;
+      int y0;
+      int y1;
+    };
+  }
+
+  Resampler::Filter Resampler::parseFilter(const QString &name, bool *ok) {
+    *ok = true;
+    QString n = name.toLower();
+    if (n == "box") {
+      return Box;
+    }
+    if (n == "bilinear") {
+      return Bilinear;
+    }
+    if (n == "lanczos3" || n == "lanczos") {
+      return Lanczos3;
+    }
+    *ok = false;
+    return Lanczos3;
+  }
+
+  Resampler::Resampler(Filter filter, int threads) :
+  filter(filter), threads(threads) {
+    if (threads <= 0) {
+      throw std::invalid_argument("Resampler thread count have to be positive!");
+    }
+    if (threads > 1) {
+      pool = new QThreadPool();
+      pool->setMaxThreadCount(threads - 1);
+    }
+  }
+
+  Resampler::~Resampler() {
+    if (pool != nullptr) {
+      pool->waitForDone();
+      delete pool;
+    }
+  }
+
+  void Resampler::computeWeights(Weights &w, int srcSize, int dstSize) const {
+    double scale = (double) srcSize / (double) dstSize;
+    // filter is stretched when downscaling, so it averages all covered samples
+    double filterScale = std::max(scale, 1.0);
+    double support = filterSupport(filter) * filterScale;
+
+    w.srcSize = srcSize;
+    w.dstSize = dstSize;
+    w.taps = (int) std::ceil(support) * 2 + 1;
+    w.start.assign(dstSize, 0);
+    w.count.assign(dstSize, 0);
+    w.weights.assign((size_t) dstSize * w.taps, 0);
+
+    std::vector<double> k(w.taps);
+    for (int i = 0; i < dstSize; i++) {
+      double center = (i + 0.5) * scale;
+      int min = std::max((int) std::floor(center - support + 0.5), 0);
+      int max = std::min((int) std::floor(center + support + 0.5), srcSize);
+      int count = std::min(max - min, w.taps);
+
+      double total = 0;
+      for (int t = 0; t < count; t++) {
+        k[t] = filterValue(filter, (min + t - center + 0.5) / filterScale);
+        total += k[t];
+      }
+      if (total == 0.0) {
+        // degenerated case, take nearest sample
+        min = std::min((int) center, srcSize - 1);
+        count = 1;
+        k[0] = total = 1.0;
+      }
+
+      int16_t *weights = w.weights.data() + (size_t) i * w.taps;
+      int32_t sum = 0;
+      int largest = 0;
+      for (int t = 0; t < count; t++) {
+        weights[t] = (int16_t) std::lround(k[t] / total * WEIGHT_ONE);
+        sum += weights[t];
+        if (weights[t] > weights[largest]) {
+          largest = t;
+        }
+      }
+      // rounding error goes to the largest weight, so flat areas stay flat
+      weights[largest] = (int16_t) (weights[largest] + (WEIGHT_ONE - sum));
+      w.start[i] = min;
+      w.count[i] = count;
+    }
+  }
+
+  void Resampler::horizontalPass(const Frame &src, Frame &dst, int y0, int y1) const {
+    const int *start = horizontal.start.data();
+    const int *count = horizontal.count.data();
+    const int16_t *weights = horizontal.weights.data();
+    for (int y = y0; y < y1; y++) {
+      const uint8_t *s = src.constLine(y);
+      uint8_t *d = dst.line(y);
+      switch (src.channels()) {
+        case 1: horizontalLine<1>(s, d, dst.width(), horizontal.taps, start, count, weights); break;
+        case 2: horizontalLine<2>(s, d, dst.width(), horizontal.taps, start, count, weights); break;
+        case 3: horizontalLine<3>(s, d, dst.width(), horizontal.taps, start, count, weights); break;
+        default: horizontalLine<4>(s, d, dst.width(), horizontal.taps, start, count, weights); break;
+      }
+    }
+  }
+
+  void Resampler::verticalPass(const Frame &src, Frame &dst, int y0, int y1) const {
+    int lineBytes = dst.width() * dst.channels();
+    std::vector<int32_t> acc(lineBytes);
+    int32_t *a = acc.data();
+    for (int y = y0; y < y1; y++) {
+      std::fill(acc.begin(), acc.end(), WEIGHT_ROUND);
+      const int16_t *k = vertical.weights.data() + (size_t) y * vertical.taps;
+      for (int t = 0; t < vertical.count[y]; t++) {
+        const uint8_t *s = src.constLine(vertical.start[y] + t);
+        int32_t w = k[t];
+        // simple loop over continuous line, compiler vectorises it
+        for (int x = 0; x < lineBytes; x++) {
+          a[x] += s[x] * w;
+        }
+      }
+      uint8_t *d = dst.line(y);
+      for (int x = 0; x < lineBytes; x++) {
+        d[x] = clamp8(a[x]);
+      }
+    }
+  }
+
+  void Resampler::runParallel(int rows, const std::function<void(int, int)> &pass) {
+    int chunks = std::min(threads, std::max(1, rows / MIN_ROWS_PER_THREAD));
+    if (chunks <= 1 || pool == nullptr) {
+      pass(0, rows);
+      return;
+    }
+    int chunkRows = (rows + chunks - 1) / chunks;
+    for (int c = 1; c < chunks; c++) {
+      int y0 = c * chunkRows;
+      int y1 = std::min(rows, y0 + chunkRows);
+      if (y0 < y1) {
+        pool->start(new PassTask(pass, y0, y1));
+      }
+    }
+    // first chunk is processed by calling thread
+    pass(0, std::min(rows, chunkRows));
+    pool->waitForDone();
+  }
+
+  Frame Resampler::resize(const Frame &frame, int width, int height) {
+    if (width <= 0 || height <= 0) {
+      throw std::invalid_argument("Target dimensions have to be positive");
+    }
+    Frame src = frame.converted(Frame::Interleaved);
+    if (src.width() == width && src.height() == height) {
+      return src;
+    }
+    if (horizontal.srcSize != src.width() || horizontal.dstSize != width) {
+      computeWeights(horizontal, src.width(), width);
+    }
+    if (vertical.srcSize != src.height() || vertical.dstSize != height) {
+      computeWeights(vertical, src.height(), height);
+    }
+
+    Frame tmp = src;
+    if (width != src.width()) {
+      tmp = Frame(width, src.height(), src.channels(), Frame::Interleaved);
+      // make data private before threads write into the frame
+      tmp.data();
+      runParallel(src.height(), [this, &src, &tmp](int y0, int y1) {
+        horizontalPass(src, tmp, y0, y1);
+      });
+    }
+    if (height == src.height()) {
+      return tmp;
+    }
+    Frame out(width, height, src.channels(), Frame::Interleaved);
+    out.data();
+    runParallel(height, [this, &tmp, &out](int y0, int y1) {
+      verticalPass(tmp, out, y0, y1);
+    });
+    return out;
+  }
+
+}
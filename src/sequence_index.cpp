@@ -0,0 +1,207 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <TimeLapse/sequence_index.h>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+
+#include <limits>
+
+namespace timelapse {
+
+  namespace {
+    constexpr quint32 INDEX_MAGIC = 0x544c4958; // "TLIX"
+    constexpr quint32 INDEX_VERSION = 2;
+    constexpr qint64 NO_TIMESTAMP = std::numeric_limits<qint64>::min();
+  }
+
+  SequenceIndex::SequenceIndex(QTextStream *_verboseOutput, QTextStream *_err) :
+  verboseOutput(_verboseOutput), err(_err) {
+  }
+
+  void SequenceIndex::setFastLuminance(bool fast) {
+    QMutexLocker locker(&mutex);
+    fastLuminance = fast;
+  }
+
+  SequenceIndex::DirectoryIndex &SequenceIndex::directory(const QString &path) {
+    auto it = directories.find(path);
+    if (it == directories.end()) {
+      it = directories.insert(path, DirectoryIndex());
+      load(path, it.value());
+    }
+    return it.value();
+  }
+
+  void SequenceIndex::load(const QString &path, DirectoryIndex &index) {
+    QFile file(QDir(path).filePath(FILE_NAME));
+    if (!file.exists()) {
+      return;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+      *err << "Can't open index " << file.fileName() << ": " << file.errorString() << endl;
+      return;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    in >> magic >> version >> count;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+      *err << "Ignore index " << file.fileName() << " with unsupported format" << endl;
+      return;
+    }
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+      QString name;
+      Entry entry;
+      qint64 size;
+      qint64 modified;
+      qint32 width;
+      qint32 height;
+      qint64 timestamp;
+      double luminance;
+      bool fast;
+      in >> name >> size >> modified >> width >> height >> timestamp >> luminance >> fast;
+      entry.size = size;
+      entry.modified = modified;
+      entry.width = width;
+      entry.height = height;
+      if (timestamp != NO_TIMESTAMP) {
+        entry.timestamp = QDateTime::fromMSecsSinceEpoch(timestamp);
+      }
+      entry.luminance = luminance;
+      entry.fastLuminance = fast;
+      index.entries.insert(name, entry);
+    }
+    if (in.status() != QDataStream::Ok) {
+      *err << "Index " << file.fileName() << " is corrupted, it will be rebuilt" << endl;
+      index.entries.clear();
+      index.dirty = true;
+      return;
+    }
+    *verboseOutput << "Loaded index " << file.fileName() << " with " << index.entries.size() << " entries" << endl;
+  }
+
+  bool SequenceIndex::lookup(InputImageInfo &info) {
+    QFileInfo fileInfo = info.fileInfo();
+    QMutexLocker locker(&mutex);
+    DirectoryIndex &index = directory(fileInfo.absolutePath());
+    auto it = index.entries.constFind(fileInfo.fileName());
+    if (it == index.entries.constEnd() ||
+        it->size != fileInfo.size() ||
+        it->modified != fileInfo.lastModified().toMSecsSinceEpoch()) {
+      return false;
+    }
+    if (it->width > 0 && it->height > 0) {
+      info.width = it->width;
+      info.height = it->height;
+    }
+    if (it->timestamp.isValid()) {
+      info.timestamp = it->timestamp;
+    }
+    // luminance measured on scaled image is just approximation of full resolution one
+    if (it->luminance >= 0 && (fastLuminance || !it->fastLuminance)) {
+      info.luminance = it->luminance;
+    }
+    return true;
+  }
+
+  void SequenceIndex::update(const InputImageInfo &info) {
+    QFileInfo fileInfo = info.fileInfo();
+    QMutexLocker locker(&mutex);
+    DirectoryIndex &index = directory(fileInfo.absolutePath());
+    Entry &entry = index.entries[fileInfo.fileName()];
+    int64_t size = fileInfo.size();
+    int64_t modified = fileInfo.lastModified().toMSecsSinceEpoch();
+    if (entry.size != size || entry.modified != modified) {
+      // file was changed, previous metadata are not valid
+      entry = Entry();
+      entry.size = size;
+      entry.modified = modified;
+    }
+    if (info.width > 0 && info.height > 0) {
+      entry.width = info.width;
+      entry.height = info.height;
+    }
+    if (info.timestamp.isValid()) {
+      entry.timestamp = info.timestamp;
+    }
+    if (info.luminance >= 0 && (entry.luminance < 0 || !fastLuminance || entry.fastLuminance)) {
+      entry.luminance = info.luminance;
+      entry.fastLuminance = fastLuminance;
+    }
+    index.dirty = true;
+  }
+
+  bool SequenceIndex::save() {
+    QMutexLocker locker(&mutex);
+    bool result = true;
+    for (auto it = directories.begin(); it != directories.end(); ++it) {
+      if (!it->dirty) {
+        continue;
+      }
+      // drop entries of removed files
+      QDir dir(it.key());
+      for (auto entry = it->entries.begin(); entry != it->entries.end();) {
+        if (QFileInfo(dir.filePath(entry.key())).exists()) {
+          ++entry;
+        } else {
+          entry = it->entries.erase(entry);
+        }
+      }
+      if (save(it.key(), it.value())) {
+        it->dirty = false;
+      } else {
+        result = false;
+      }
+    }
+    return result;
+  }
+
+  bool SequenceIndex::save(const QString &path, const DirectoryIndex &index) {
+    // index is written to temporary file and renamed, readers never see partial file
+    QSaveFile file(QDir(path).filePath(FILE_NAME));
+    if (!file.open(QIODevice::WriteOnly)) {
+      *err << "Can't write index " << file.fileName() << ": " << file.errorString() << endl;
+      return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << INDEX_MAGIC << INDEX_VERSION << (quint32) index.entries.size();
+    for (auto it = index.entries.constBegin(); it != index.entries.constEnd(); ++it) {
+      out << it.key()
+        << (qint64) it->size << (qint64) it->modified
+        << (qint32) it->width << (qint32) it->height
+        << (qint64) (it->timestamp.isValid() ? it->timestamp.toMSecsSinceEpoch() : NO_TIMESTAMP)
+        << it->luminance << it->fastLuminance;
+    }
+    if (!file.commit()) {
+      *err << "Can't write index " << file.fileName() << ": " << file.errorString() << endl;
+      return false;
+    }
+    *verboseOutput << "Index " << file.fileName() << " saved with " << index.entries.size() << " entries" << endl;
+    return true;
+  }
+
+}
@@ -19,9 +19,11 @@
 
 #include <TimeLapse/timelapse.h>
 #include <TimeLapse/input_image_info.h>
+#include <TimeLapse/frame.h>
 
 namespace timelapse {
 void registerQtMetaTypes() {
   qRegisterMetaType<QList<InputImageInfo>>("QList<InputImageInfo>");
+  qRegisterMetaType<Frame>("Frame");
 }
 }
@@ -27,11 +27,13 @@
 
 #include <TimeLapse/pipeline.h>
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/decoded_frame_cache.h>
 #include <TimeLapse/pipeline_frame_mapping.h>
 #include <TimeLapse/pipeline_frame_prepare.h>
 #include <TimeLapse/pipeline_video_assembly.h>
 #include <TimeLapse/pipeline_write_frame.h>
 #include <TimeLapse/pipeline_resize_frame.h>
+#include <TimeLapse/pipeline_temporal_average.h>
 #include <TimeLapse/pipeline_deflicker.h>
 
 #include <QtCore/QObject>
@@ -41,6 +43,10 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QCommandLineParser>
 #include <QtCore/QDir>
+#include <QtCore/QThread>
+
+#include <algorithm>
+#include <stdexcept>
 
 using namespace std;
 using namespace timelapse;
@@ -50,15 +56,16 @@ namespace timelapse {
   TimeLapseAssembly::TimeLapseAssembly(int &argc, char **argv) :
   QCoreApplication(argc, argv),
   _out(stdout), _err(stderr),
-  _dryRun(false), deflickerAvg(false), deflickerDebugView(false), wmaCount(-1),
+  _dryRun(false), deflickerAvg(false), deflickerDebugView(false), deflickerFastLuminance(false), wmaCount(-1),
   _verboseOutput(stdout), _blackHole(nullptr),
   _forceOverride(false),
   _tmpBaseDir(QDir::tempPath()),
-  _tempDir(nullptr),
+  _tempDir(nullptr), _tempFrames(false), _variableFrameRate(false),
   _output("timelapse.mkv"),
-  _width(1920), _height(1080), _adaptiveResize(true),
+  _width(1920), _height(1080), _adaptiveResize(true), _useResampler(false), _resizeFilter(Resampler::Lanczos3),
   _fps(25), _length(-1), _frameCount(-1), _bitrate("40000k"), _codec("libx264"),
   _noStrictInterval(false), _blendFrames(false), _blendBeforeResize(false),
+  _motionBlur(1), _threaded(false), _workers(1), _maxFrames(DEFAULT_MAX_IN_FLIGHT_FRAMES), _maxMemory(0), _readAhead(0), _useIndex(false),
   pipeline(nullptr) {
 
     setApplicationName("TimeLapse assembly tool");
@@ -110,6 +117,12 @@ namespace timelapse {
       QCoreApplication::translate("main", "interpolate-resize"));
     parser.addOption(interpolateResizeOption);
 
+    QCommandLineOption resizeFilterOption(QStringList() << "resize-filter",
+      QCoreApplication::translate("main", "Resize frames by internal resampler with given filter: "
+      "box, bilinear or lanczos3. ImageMagick resize is used by default."),
+      QCoreApplication::translate("main", "filter"));
+    parser.addOption(resizeFilterOption);
+
     QCommandLineOption fpsOption(QStringList() << "fps",
       QCoreApplication::translate("main", "Output video fps (frames per second). Default is 25."),
       QCoreApplication::translate("main", "fps"));
@@ -132,7 +145,8 @@ namespace timelapse {
     parser.addOption(codecOption);
 
     QCommandLineOption pixFmtOption(QStringList() << "pixel-format",
-       QCoreApplication::translate("main", "Video pixel format. Default is automatic selection. Use \"yuv420p\" for best interoperability.").arg(_codec),
+       QCoreApplication::translate("main", "Video pixel format. Default is automatic selection for temporary frames, "
+       "\"yuv420p\" when frames are piped to the encoder. Use \"yuv420p\" for best interoperability.").arg(_codec),
        QCoreApplication::translate("main", "pixel-format"));
     parser.addOption(pixFmtOption);
 
@@ -142,10 +156,22 @@ namespace timelapse {
       "timestamp (EXIF metadata will be used or file modification time)."));
     parser.addOption(noStrictIntervalOption);
 
+    QCommandLineOption vfrOption(QStringList() << "vfr",
+      QCoreApplication::translate("main", "Variable frame rate output. Every output frame is encoded once "
+      "with duration computed from image mapping, instead of duplicating it in video with constant frame rate. "
+      "Useful with \"no-strict-interval\" option, implies \"temp-frames\"."));
+    parser.addOption(vfrOption);
+
     QCommandLineOption blendFramesOption(QStringList() << "blend-frames",
       QCoreApplication::translate("main", "Blend frame transition."));
     parser.addOption(blendFramesOption);
 
+    QCommandLineOption motionBlurOption(QStringList() << "motion-blur",
+      QCoreApplication::translate("main", "Average every image with previous images (count - 1) "
+      "to get motion blurred \"long exposure\" video. Useful for dense captures."),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(motionBlurOption);
+
     QCommandLineOption blendBeforeResizeOption(QStringList() << "blend-before-resize",
       QCoreApplication::translate("main", "Blend frame before resize (slower)."));
     parser.addOption(blendBeforeResizeOption);
@@ -165,6 +191,68 @@ namespace timelapse {
       "and second half from image with corrected luminance."));
     parser.addOption(deflickerDebugViewOption);
 
+    QCommandLineOption deflickerFastLuminanceOption(QStringList() << "deflicker-fast-luminance",
+      QCoreApplication::translate("main", "Compute luminance for deflicker from 1/8 scaled images "
+      "(JPEG images are not fully decoded)."));
+    parser.addOption(deflickerFastLuminanceOption);
+
+    QCommandLineOption threadedOption(QStringList() << "threaded",
+      QCoreApplication::translate("main", "Run every processing stage in its own thread."));
+    parser.addOption(threadedOption);
+
+    QCommandLineOption workersOption(QStringList() << "workers",
+      QCoreApplication::translate("main", "Number of worker threads used by stateless stages "
+      "(image loading, luminance computation and adjustment, resize, frame writing). Default is 1."),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(workersOption);
+
+    QCommandLineOption maxFramesOption(QStringList() << "max-frames",
+      QCoreApplication::translate("main", "Maximum number of decoded frames in flight (threaded mode only). Default is %1.")
+        .arg(DEFAULT_MAX_IN_FLIGHT_FRAMES),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(maxFramesOption);
+
+    QCommandLineOption maxMemoryOption(QStringList() << "max-memory",
+      QCoreApplication::translate("main", "Maximum memory used by decoded frames in flight, in MiB (threaded mode only). "
+      "Unlimited by default."),
+      QCoreApplication::translate("main", "MiB"));
+    parser.addOption(maxMemoryOption);
+
+    QCommandLineOption readAheadOption(QStringList() << "read-ahead",
+      QCoreApplication::translate("main", "Count of images decoded ahead on background threads "
+      "while current frame is processed. It is limited by frame budget in threaded mode. Disabled by default."),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(readAheadOption);
+
+    QCommandLineOption frameCacheOption(QStringList() << "frame-cache",
+      QCoreApplication::translate("main", "Directory for persistent cache of decoded frames. "
+      "Cached frames are reused by following runs with the same inputs. It may be shared by more processes."),
+      QCoreApplication::translate("main", "directory"));
+    parser.addOption(frameCacheOption);
+
+    QCommandLineOption frameCacheSizeOption(QStringList() << "frame-cache-size",
+      QCoreApplication::translate("main", "Size limit of decoded frame cache in MiB, "
+      "least recently used frames are removed. Default is %1.").arg(DEFAULT_FRAME_CACHE_SIZE / (1024 * 1024)),
+      QCoreApplication::translate("main", "MiB"));
+    parser.addOption(frameCacheSizeOption);
+
+    QCommandLineOption indexOption(QStringList() << "index",
+      QCoreApplication::translate("main", "Keep metadata index (%1) in input directories. "
+      "Timestamps and luminance of indexed images are not computed again, "
+      "analysis passes don't decode them at all.").arg(SequenceIndex::FILE_NAME));
+    parser.addOption(indexOption);
+
+    QCommandLineOption statsOption(QStringList() << "stats",
+      QCoreApplication::translate("main", "Write per-stage performance report (JSON) to given file."),
+      QCoreApplication::translate("main", "file"));
+    parser.addOption(statsOption);
+
+    QCommandLineOption traceOption(QStringList() << "trace",
+      QCoreApplication::translate("main", "Record execution of pipeline stages to given file "
+      "(Chrome trace-event format, it may be opened by chrome://tracing or Perfetto)."),
+      QCoreApplication::translate("main", "file"));
+    parser.addOption(traceOption);
+
     QCommandLineOption verboseOption(QStringList() << "V" << "verbose",
       QCoreApplication::translate("main", "Verbose output."));
     parser.addOption(verboseOption);
@@ -186,6 +274,19 @@ namespace timelapse {
       QCoreApplication::translate("main", "Keep temporary files (Program will cleanup temporary files at the end by default)."));
     parser.addOption(keepTempOption);
 
+    QCommandLineOption tempFramesOption(QStringList() << "temp-frames",
+      QCoreApplication::translate("main", "Write output frames to temp directory as JPEG images and assemble video "
+      "when all frames are ready. By default, raw frames are piped to the encoder while they are processed."));
+    parser.addOption(tempFramesOption);
+
+    QCommandLineOption frameFormatOption(QStringList() << "frame-format",
+      QCoreApplication::translate("main", "Format of temporary frames (with \"temp-frames\"): "
+      "ppm, pam, png[:level] or jpeg[:quality[:subsampling]]. "
+      "Level is PNG compression level (0-9), quality is JPEG quality (1-100) "
+      "and subsampling is JPEG chroma subsampling (420, 422 or 444). Default is jpeg."),
+      QCoreApplication::translate("main", "format"));
+    parser.addOption(frameFormatOption);
+
     // Process the actual command line arguments given by the user
     parser.process(*this);
 
@@ -206,8 +307,11 @@ namespace timelapse {
 
     _forceOverride = parser.isSet(forceOption);
     _dryRun = parser.isSet(dryRunOption);
+    _tempFrames = parser.isSet(tempFramesOption);
     deflickerAvg = parser.isSet(deflickerAvgOption);
     deflickerDebugView = parser.isSet(deflickerDebugViewOption);
+    deflickerFastLuminance = parser.isSet(deflickerFastLuminanceOption);
+    _useIndex = parser.isSet(indexOption);
 
     // wma?
     if (parser.isSet(wmaCountOption)) {
@@ -251,6 +355,11 @@ namespace timelapse {
     }
 
     _adaptiveResize = !parser.isSet(interpolateResizeOption);
+    if (parser.isSet(resizeFilterOption)) {
+      _useResampler = true;
+      _resizeFilter = Resampler::parseFilter(parser.value(resizeFilterOption), &ok);
+      if (!ok) die << "Can't parse resize filter";
+    }
 
     if (parser.isSet(fpsOption)) {
       _fps = parser.value(fpsOption).toFloat(&ok);
@@ -268,18 +377,80 @@ namespace timelapse {
       _codec = parser.value(codecOption);
     if (parser.isSet(pixFmtOption))
       _pixelFormat = parser.value(pixFmtOption);
+    if (parser.isSet(frameFormatOption)) {
+      _frameFormat = FrameFormat::parse(parser.value(frameFormatOption), &ok);
+      if (!ok) die << "Can't parse frame format";
+    }
 
     _noStrictInterval = parser.isSet(noStrictIntervalOption);
     if (_noStrictInterval && _length < 0) {
       _err << "Video length is not setup, ignore \"no-strict-interval\"." << endl;
     }
 
+    _variableFrameRate = parser.isSet(vfrOption);
+    if (_variableFrameRate) {
+      _tempFrames = true;
+    }
+
     _blendFrames = parser.isSet(blendFramesOption);
     if (_blendFrames && _length < 0) {
       _err << "Video length is not setup, ignore \"blend-frame\" option." << endl;
     }
 
     _blendBeforeResize = parser.isSet(blendBeforeResizeOption);
+    if (parser.isSet(motionBlurOption)) {
+      _motionBlur = parser.value(motionBlurOption).toInt(&ok);
+      if (!ok) die << "Can't parse motion blur count";
+      if (_motionBlur < 1) die << "Motion blur count have to be positive!";
+    }
+    _threaded = parser.isSet(threadedOption);
+    if (parser.isSet(workersOption)) {
+      _workers = parser.value(workersOption).toInt(&ok);
+      if (!ok) die << "Can't parse worker count";
+      if (_workers < 1) die << "Worker count have to be positive!";
+    }
+    if (parser.isSet(maxFramesOption)) {
+      _maxFrames = parser.value(maxFramesOption).toInt(&ok);
+      if (!ok) die << "Can't parse max frames";
+      if (_maxFrames < MIN_IN_FLIGHT_FRAMES) die << QString("Max frames have to be at least %1").arg(MIN_IN_FLIGHT_FRAMES);
+    }
+    if (parser.isSet(maxMemoryOption)) {
+      _maxMemory = parser.value(maxMemoryOption).toLongLong(&ok) * 1024 * 1024;
+      if (!ok) die << "Can't parse max memory";
+      if (_maxMemory <= 0) die << "Max memory have to be positive!";
+    }
+    if (!_threaded && (parser.isSet(maxFramesOption) || parser.isSet(maxMemoryOption))) {
+      _err << "Frame budget is used just in threaded mode, ignore \"max-frames\" and \"max-memory\" options." << endl;
+    }
+    if (parser.isSet(readAheadOption)) {
+      _readAhead = parser.value(readAheadOption).toInt(&ok);
+      if (!ok) die << "Can't parse read-ahead count";
+      if (_readAhead < 0) die << "Read-ahead count can't be negative!";
+    }
+    if (parser.isSet(frameCacheOption)) {
+      int64_t frameCacheSize = DEFAULT_FRAME_CACHE_SIZE;
+      if (parser.isSet(frameCacheSizeOption)) {
+        frameCacheSize = parser.value(frameCacheSizeOption).toLongLong(&ok) * 1024 * 1024;
+        if (!ok) die << "Can't parse frame cache size";
+        if (frameCacheSize <= 0) die << "Frame cache size have to be positive!";
+      }
+      try {
+        _frameCache = QSharedPointer<DecodedFrameCache>(
+          new DecodedFrameCache(QDir(parser.value(frameCacheOption)), frameCacheSize));
+      } catch (const std::invalid_argument &e) {
+        die << QString::fromUtf8(e.what());
+      }
+    } else if (parser.isSet(frameCacheSizeOption)) {
+      _err << "Frame cache is not enabled, ignore \"frame-cache-size\" option." << endl;
+    }
+    if (parser.isSet(statsOption)) {
+      _statsFile = parser.value(statsOption);
+      if (_statsFile.isEmpty()) die << "Stats file is empty";
+    }
+    if (parser.isSet(traceOption)) {
+      _traceFile = parser.value(traceOption);
+      if (_traceFile.isEmpty()) die << "Trace file is empty";
+    }
 
     if (parser.isSet(tmpOption))
       _tmpBaseDir = parser.value(tmpOption);
@@ -305,6 +476,12 @@ namespace timelapse {
 
   void TimeLapseAssembly::cleanup2(int exitCode) {
     if (pipeline != nullptr) {
+      if (!_statsFile.isEmpty()) {
+        pipeline->writeStats(_statsFile);
+      }
+      if (!_traceFile.isEmpty()) {
+        pipeline->writeTrace(_traceFile);
+      }
       pipeline->deleteLater();
       pipeline = nullptr;
     }
@@ -322,44 +499,88 @@ namespace timelapse {
 
     // build processing pipeline
     pipeline = Pipeline::createWithFileSource(inputArguments, _extensions, false, &_verboseOutput, &_err);
+    pipeline->setReadAhead(_readAhead);
+    pipeline->setFrameCache(_frameCache);
+    if (_useIndex) {
+      pipeline->setSequenceIndex(QSharedPointer<SequenceIndex>(new SequenceIndex(&_verboseOutput, &_err)));
+    }
+    if (!_traceFile.isEmpty()) {
+      pipeline->enableTrace();
+    }
+    if (_threaded) {
+      pipeline->setThreaded();
+      pipeline->setFlowControl(_maxFrames, _maxMemory);
+    }
+    pipeline->setWorkers(_workers);
+    pipeline->setFastAnalysis(deflickerFastLuminance);
 
     if (deflickerAvg) {
-      *pipeline << new ComputeLuminance(&_verboseOutput);
+      *pipeline << pipeline->parallel([](QTextStream *verboseOutput, QTextStream *) {
+        return new ComputeLuminance(verboseOutput);
+      });
     }
 
     if (_length < 0) {
       *pipeline << new OneToOneFrameMapping();
     } else if (_noStrictInterval) {
-      *pipeline << new ImageMetadataReader(&_verboseOutput, &_err);
-      *pipeline << new VariableIntervalFrameMapping(&_verboseOutput, &_err, _length, _fps);
+      *pipeline << new ImageMetadataReader(pipeline->stageVerboseOutput(), pipeline->stageErr());
+      *pipeline << new VariableIntervalFrameMapping(pipeline->stageVerboseOutput(), pipeline->stageErr(), _length, _fps);
     } else {
-      *pipeline << new ConstIntervalFrameMapping(&_verboseOutput, &_err, _length, _fps);
+      *pipeline << new ConstIntervalFrameMapping(pipeline->stageVerboseOutput(), pipeline->stageErr(), _length, _fps);
     }
 
     if (deflickerAvg) {
       if (wmaCount > 0)
-        *pipeline << new WMALuminance(&_verboseOutput, wmaCount);
+        *pipeline << new WMALuminance(pipeline->stageVerboseOutput(), wmaCount);
       else
-        *pipeline << new ComputeAverageLuminance(&_verboseOutput);
-      *pipeline << new AdjustLuminance(&_verboseOutput, deflickerDebugView);
+        *pipeline << new ComputeAverageLuminance(pipeline->stageVerboseOutput());
+      *pipeline << pipeline->parallel([this](QTextStream *verboseOutput, QTextStream *) {
+        return new AdjustLuminance(verboseOutput, deflickerDebugView);
+      });
     }
 
+    ImageHandlerFactory resizeFactory = [this](QTextStream *verboseOutput, QTextStream *) {
+      if (_useResampler) {
+        // without worker pool, rows of one frame are resampled in parallel
+        int threads = _workers > 1 ? 1 : std::max(1, QThread::idealThreadCount());
+        return new ResizeFrame(verboseOutput, _width, _height, _resizeFilter, threads);
+      }
+      return new ResizeFrame(verboseOutput, _width, _height, _adaptiveResize);
+    };
+
+    // motion blur works on input images, before they are mapped to video frames,
+    // after resize when possible (window of smaller frames)
+    auto appendMotionBlur = [this]() {
+      if (_motionBlur > 1) {
+        *pipeline << new TemporalAverage(pipeline->stageVerboseOutput(), _motionBlur);
+      }
+    };
+
     if (_blendFrames) {
       if (_blendBeforeResize) {
-        *pipeline << new BlendFramePrepare(&_verboseOutput, _length * _fps);
-        *pipeline << new ResizeFrame(&_verboseOutput, _width, _height, _adaptiveResize);
+        appendMotionBlur();
+        *pipeline << new BlendFramePrepare(pipeline->stageVerboseOutput(), _length * _fps);
+        *pipeline << pipeline->parallel(resizeFactory);
       } else {
-        *pipeline << new ResizeFrame(&_verboseOutput, _width, _height, _adaptiveResize);
-        *pipeline << new BlendFramePrepare(&_verboseOutput, _length * _fps);
+        *pipeline << pipeline->parallel(resizeFactory);
+        appendMotionBlur();
+        *pipeline << new BlendFramePrepare(pipeline->stageVerboseOutput(), _length * _fps);
       }
     } else {
-      *pipeline << new ResizeFrame(&_verboseOutput, _width, _height, _adaptiveResize);
-      *pipeline << new FramePrepare(&_verboseOutput, _length * _fps);
+      *pipeline << pipeline->parallel(resizeFactory);
+      appendMotionBlur();
+      *pipeline << new FramePrepare(pipeline->stageVerboseOutput(), _length * _fps);
     }
-    *pipeline << new WriteFrame(QDir(_tempDir->path()), &_verboseOutput, _dryRun);
+    if (_tempFrames) {
+      *pipeline << new AsyncWriteFrame(QDir(_tempDir->path()), pipeline->stageVerboseOutput(), pipeline->stageErr(),
+        _dryRun, !_variableFrameRate, _frameFormat);
 
-    * pipeline << new VideoAssembly(QDir(_tempDir->path()), &_verboseOutput, &_err, _dryRun,
-      _output, _width, _height, _fps, _bitrate, _codec, "", _pixelFormat);
+      * pipeline << new VideoAssembly(QDir(_tempDir->path()), pipeline->stageVerboseOutput(), pipeline->stageErr(), _dryRun,
+        _output, _width, _height, _fps, _bitrate, _codec, "", _pixelFormat, _variableFrameRate, _frameFormat);
+    } else {
+      *pipeline << new StreamingVideoAssembly(pipeline->stageVerboseOutput(), pipeline->stageErr(), _dryRun,
+        _output, _fps, _bitrate, _codec, "", _pixelFormat);
+    }
 
     connect(pipeline, &Pipeline::done, this, &TimeLapseAssembly::cleanup);
     connect(pipeline, &Pipeline::error, this, &TimeLapseAssembly::onError);
@@ -23,6 +23,8 @@
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline.h>
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/pipeline_write_frame.h>
+#include <TimeLapse/resampler.h>
 
 #include <Magick++.h>
 
@@ -62,6 +64,7 @@ namespace timelapse {
     bool _dryRun;
     bool deflickerAvg;
     bool deflickerDebugView;
+    bool deflickerFastLuminance;
     size_t wmaCount;
     QTextStream _verboseOutput;
     BlackHoleDevice *_blackHole;
@@ -70,6 +73,11 @@ namespace timelapse {
 
     QTemporaryDir *_tempDir;
 
+    /* write frames to temp directory instead of piping them to encoder */
+    bool _tempFrames;
+    bool _variableFrameRate;
+    FrameFormat _frameFormat;
+
     /* output properties*/
     /* output file name */
     QFileInfo _output;
@@ -79,6 +87,9 @@ namespace timelapse {
     int _height;
 
     bool _adaptiveResize;
+    /* internal resampler is used when filter is set */
+    bool _useResampler;
+    Resampler::Filter _resizeFilter;
 
     /* output video fps, default 25 */
     float _fps;
@@ -99,6 +110,33 @@ namespace timelapse {
     bool _noStrictInterval;
     bool _blendFrames;
     bool _blendBeforeResize;
+    /* count of averaged images (motion blur), 1 is disabled */
+    int _motionBlur;
+
+    /* run pipeline stages in parallel threads */
+    bool _threaded;
+
+    /* count of workers for stateless stages */
+    int _workers;
+
+    /* in-flight frame budget for threaded mode, memory in bytes (0 is unlimited) */
+    int _maxFrames;
+    int64_t _maxMemory;
+
+    /* count of images decoded ahead by the loader */
+    int _readAhead;
+
+    /* persistent cache of decoded frames, null when it is disabled */
+    QSharedPointer<DecodedFrameCache> _frameCache;
+
+    /* keep metadata index in input directories */
+    bool _useIndex;
+
+    /* file for per-stage performance report, empty when it is disabled */
+    QString _statsFile;
+
+    /* file for pipeline execution trace, empty when it is disabled */
+    QString _traceFile;
 
     Pipeline *pipeline;
   };
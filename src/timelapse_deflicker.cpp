@@ -24,6 +24,8 @@
 #include <TimeLapse/error_message_helper.h>
 
 #include <TimeLapse/pipeline_handler.h>
+#include <TimeLapse/decoded_frame_cache.h>
+#include <TimeLapse/pipeline_watch_source.h>
 #include <TimeLapse/pipeline_frame_mapping.h>
 #include <TimeLapse/pipeline_frame_prepare.h>
 #include <TimeLapse/pipeline_video_assembly.h>
@@ -41,7 +43,9 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QCommandLineParser>
 #include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 
+#include <stdexcept>
 #include <vector>
 
 using namespace std;
@@ -52,7 +56,9 @@ namespace timelapse {
   TimeLapseDeflicker::TimeLapseDeflicker(int &argc, char **argv) :
   QCoreApplication(argc, argv),
   out(stdout), err(stderr),
-  dryRun(false), debugView(false),
+  dryRun(false), debugView(false), gain(1.0), threaded(false), workers(1),
+  maxFrames(DEFAULT_MAX_IN_FLIGHT_FRAMES), maxMemory(0), readAhead(0), fastLuminance(false), useIndex(false),
+  watch(false), watchTimeoutMs(DEFAULT_WATCH_TIMEOUT_MS),
   wmaCount(-1),
   verboseOutput(stdout), blackHole(nullptr),
   pipeline(nullptr), output() {
@@ -86,6 +92,12 @@ namespace timelapse {
       QCoreApplication::translate("main", "directory"));
     parser.addOption(outputOption);
 
+    QCommandLineOption previewOption(QStringList() << "preview",
+      QCoreApplication::translate("main", "Write also %1p preview of deflickered frames to given directory.")
+        .arg(PREVIEW_HEIGHT),
+      QCoreApplication::translate("main", "directory"));
+    parser.addOption(previewOption);
+
     QCommandLineOption wmaCountOption(QStringList() << "wm-average",
       QCoreApplication::translate("main",
       "Use weighted moving average for luminance.\n"
@@ -98,12 +110,102 @@ namespace timelapse {
       QCoreApplication::translate("main", "Just parse arguments, check inputs and prints informations."));
     parser.addOption(dryRunOption);
 
+    QCommandLineOption frameFormatOption(QStringList() << "frame-format",
+      QCoreApplication::translate("main", "Format of written frames: ppm, pam, png[:level] or jpeg[:quality[:subsampling]]. "
+      "Level is PNG compression level (0-9), quality is JPEG quality (1-100) "
+      "and subsampling is JPEG chroma subsampling (420, 422 or 444). Default is jpeg."),
+      QCoreApplication::translate("main", "format"));
+    parser.addOption(frameFormatOption);
+
     QCommandLineOption debugViewOption(QStringList() << "w" << "debug-view",
       QCoreApplication::translate("main",
       "Composite one half of output image from original and second half from updated image."
       ));
     parser.addOption(debugViewOption);
 
+    QCommandLineOption gainOption(QStringList() << "gain",
+      QCoreApplication::translate("main", "Multiply color samples of deflickered frames by constant gain (exposure correction)."),
+      QCoreApplication::translate("main", "factor"));
+    parser.addOption(gainOption);
+
+    QCommandLineOption fastLuminanceOption(QStringList() << "fast-luminance",
+      QCoreApplication::translate("main", "Compute luminance from 1/8 scaled images "
+      "(JPEG images are not fully decoded)."));
+    parser.addOption(fastLuminanceOption);
+
+    QCommandLineOption threadedOption(QStringList() << "threaded",
+      QCoreApplication::translate("main", "Run every processing stage in its own thread."));
+    parser.addOption(threadedOption);
+
+    QCommandLineOption workersOption(QStringList() << "workers",
+      QCoreApplication::translate("main", "Number of worker threads used by stateless stages "
+      "(image loading, luminance computation and adjustment, frame writing). Default is 1."),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(workersOption);
+
+    QCommandLineOption maxFramesOption(QStringList() << "max-frames",
+      QCoreApplication::translate("main", "Maximum number of decoded frames in flight (threaded mode only). Default is %1.")
+        .arg(DEFAULT_MAX_IN_FLIGHT_FRAMES),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(maxFramesOption);
+
+    QCommandLineOption maxMemoryOption(QStringList() << "max-memory",
+      QCoreApplication::translate("main", "Maximum memory used by decoded frames in flight, in MiB (threaded mode only). "
+      "Unlimited by default."),
+      QCoreApplication::translate("main", "MiB"));
+    parser.addOption(maxMemoryOption);
+
+    QCommandLineOption readAheadOption(QStringList() << "read-ahead",
+      QCoreApplication::translate("main", "Count of images decoded ahead on background threads "
+      "while current frame is processed. It is limited by frame budget in threaded mode. Disabled by default."),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(readAheadOption);
+
+    QCommandLineOption frameCacheOption(QStringList() << "frame-cache",
+      QCoreApplication::translate("main", "Directory for persistent cache of decoded frames. "
+      "Cached frames are reused by following runs with the same inputs. It may be shared by more processes."),
+      QCoreApplication::translate("main", "directory"));
+    parser.addOption(frameCacheOption);
+
+    QCommandLineOption frameCacheSizeOption(QStringList() << "frame-cache-size",
+      QCoreApplication::translate("main", "Size limit of decoded frame cache in MiB, "
+      "least recently used frames are removed. Default is %1.").arg(DEFAULT_FRAME_CACHE_SIZE / (1024 * 1024)),
+      QCoreApplication::translate("main", "MiB"));
+    parser.addOption(frameCacheSizeOption);
+
+    QCommandLineOption indexOption(QStringList() << "index",
+      QCoreApplication::translate("main", "Keep metadata index (%1) in input directories. "
+      "Timestamps and luminance of indexed images are not computed again, "
+      "analysis passes don't decode them at all.").arg(SequenceIndex::FILE_NAME));
+    parser.addOption(indexOption);
+
+    QCommandLineOption watchOption(QStringList() << "watch",
+      QCoreApplication::translate("main", "Watch input directory and process new images as they are written "
+      "(Linux only)."));
+    parser.addOption(watchOption);
+
+    QCommandLineOption watchTimeoutOption(QStringList() << "watch-timeout",
+      QCoreApplication::translate("main", "Finish watching when there is no new image for given time in seconds, "
+      "zero disables the timeout. Default is %1.").arg(DEFAULT_WATCH_TIMEOUT_MS / 1000),
+      QCoreApplication::translate("main", "seconds"));
+    parser.addOption(watchTimeoutOption);
+
+    QCommandLineOption watchSentinelOption(QStringList() << "watch-sentinel",
+      QCoreApplication::translate("main", "Finish watching when file with given name appears in the input directory."),
+      QCoreApplication::translate("main", "file"));
+    parser.addOption(watchSentinelOption);
+
+    QCommandLineOption statsOption(QStringList() << "stats",
+      QCoreApplication::translate("main", "Write per-stage performance report (JSON) to given file."),
+      QCoreApplication::translate("main", "file"));
+    parser.addOption(statsOption);
+
+    QCommandLineOption traceOption(QStringList() << "trace",
+      QCoreApplication::translate("main", "Record execution of pipeline stages to given file "
+      "(Chrome trace-event format, it may be opened by chrome://tracing or Perfetto)."),
+      QCoreApplication::translate("main", "file"));
+    parser.addOption(traceOption);
+
     QCommandLineOption verboseOption(QStringList() << "V" << "verbose",
       QCoreApplication::translate("main", "Verbose output."));
     parser.addOption(verboseOption);
@@ -131,13 +233,91 @@ namespace timelapse {
     }
 
     debugView = parser.isSet(debugViewOption);
+    fastLuminance = parser.isSet(fastLuminanceOption);
+    useIndex = parser.isSet(indexOption);
     dryRun = parser.isSet(dryRunOption);
+    threaded = parser.isSet(threadedOption);
+    bool ok = false;
+    if (parser.isSet(frameFormatOption)) {
+      frameFormat = FrameFormat::parse(parser.value(frameFormatOption), &ok);
+      if (!ok) die << "Can't parse frame format";
+    }
+    if (parser.isSet(gainOption)) {
+      gain = parser.value(gainOption).toDouble(&ok);
+      if (!ok) die << "Can't parse gain";
+      if (gain <= 0) die << "Gain have to be positive!";
+    }
+    if (parser.isSet(maxFramesOption)) {
+      maxFrames = parser.value(maxFramesOption).toInt(&ok);
+      if (!ok) die << "Can't parse max frames";
+      if (maxFrames < MIN_IN_FLIGHT_FRAMES) die << QString("Max frames have to be at least %1").arg(MIN_IN_FLIGHT_FRAMES);
+    }
+    if (parser.isSet(maxMemoryOption)) {
+      maxMemory = parser.value(maxMemoryOption).toLongLong(&ok) * 1024 * 1024;
+      if (!ok) die << "Can't parse max memory";
+      if (maxMemory <= 0) die << "Max memory have to be positive!";
+    }
+    if (!threaded && (parser.isSet(maxFramesOption) || parser.isSet(maxMemoryOption))) {
+      err << "Frame budget is used just in threaded mode, ignore \"max-frames\" and \"max-memory\" options." << endl;
+    }
+    if (parser.isSet(readAheadOption)) {
+      readAhead = parser.value(readAheadOption).toInt(&ok);
+      if (!ok) die << "Can't parse read-ahead count";
+      if (readAhead < 0) die << "Read-ahead count can't be negative!";
+    }
+    if (parser.isSet(frameCacheOption)) {
+      int64_t frameCacheSize = DEFAULT_FRAME_CACHE_SIZE;
+      if (parser.isSet(frameCacheSizeOption)) {
+        frameCacheSize = parser.value(frameCacheSizeOption).toLongLong(&ok) * 1024 * 1024;
+        if (!ok) die << "Can't parse frame cache size";
+        if (frameCacheSize <= 0) die << "Frame cache size have to be positive!";
+      }
+      try {
+        frameCache = QSharedPointer<DecodedFrameCache>(
+          new DecodedFrameCache(QDir(parser.value(frameCacheOption)), frameCacheSize));
+      } catch (const std::invalid_argument &e) {
+        die << QString::fromUtf8(e.what());
+      }
+    } else if (parser.isSet(frameCacheSizeOption)) {
+      err << "Frame cache is not enabled, ignore \"frame-cache-size\" option." << endl;
+    }
+    if (parser.isSet(statsOption)) {
+      statsFile = parser.value(statsOption);
+      if (statsFile.isEmpty()) die << "Stats file is empty";
+    }
+    if (parser.isSet(traceOption)) {
+      traceFile = parser.value(traceOption);
+      if (traceFile.isEmpty()) die << "Trace file is empty";
+    }
+    if (parser.isSet(workersOption)) {
+      workers = parser.value(workersOption).toInt(&ok);
+      if (!ok) die << "Can't parse worker count";
+      if (workers < 1) die << "Worker count have to be positive!";
+    }
 
     // inputs
     QStringList inputArgs = parser.positionalArguments();
     if (inputArgs.empty())
       die << "No input given";
 
+    watch = parser.isSet(watchOption);
+    if (watch) {
+      if (inputArgs.size() != 1 || !QFileInfo(inputArgs.first()).isDir())
+        die << "Just one input directory may be watched";
+      if (parser.isSet(watchTimeoutOption)) {
+        watchTimeoutMs = parser.value(watchTimeoutOption).toLongLong(&ok) * 1000;
+        if (!ok) die << "Can't parse watch timeout";
+        if (watchTimeoutMs < 0) die << "Watch timeout can't be negative!";
+      }
+      watchSentinel = parser.value(watchSentinelOption);
+      if (watchTimeoutMs == 0 && watchSentinel.isEmpty())
+        err << "Neither watch timeout nor sentinel is set, watching will never finish." << endl;
+      if (wmaCount == 0)
+        err << "Average luminance is computed from all images, frames will be written after watching is finished." << endl;
+    } else if (parser.isSet(watchTimeoutOption) || parser.isSet(watchSentinelOption)) {
+      err << "Directory is not watched, ignore \"watch-timeout\" and \"watch-sentinel\" options." << endl;
+    }
+
     // output
     if (!parser.isSet(outputOption))
       die << "Output directory is not set";
@@ -147,6 +327,15 @@ namespace timelapse {
     if (!output.mkpath("."))
       die << QString("Can't create output directory %1 !").arg(output.path());
 
+    if (parser.isSet(previewOption)) {
+      previewOutput = parser.value(previewOption);
+      QDir previewDir(previewOutput);
+      if (previewDir.absolutePath() == output.absolutePath())
+        die << "Preview directory have to be different from output directory!";
+      if (!previewDir.mkpath("."))
+        die << QString("Can't create preview directory %1 !").arg(previewDir.path());
+    }
+
     return inputArgs;
   }
 
@@ -160,6 +349,12 @@ namespace timelapse {
 
   void TimeLapseDeflicker::cleanup2(int exitCode) {
     if (pipeline != nullptr) {
+      if (!statsFile.isEmpty()) {
+        pipeline->writeStats(statsFile);
+      }
+      if (!traceFile.isEmpty()) {
+        pipeline->writeTrace(traceFile);
+      }
       pipeline->deleteLater();
       pipeline = nullptr;
     }
@@ -172,17 +367,55 @@ namespace timelapse {
     QStringList inputArgs = parseArguments();
 
     // build processing pipeline
-    pipeline = Pipeline::createWithFileSource(inputArgs, QStringList(), false, &verboseOutput, &err);
+    if (watch) {
+      pipeline = Pipeline::createWithWatchSource(inputArgs.first(), QStringList(), watchTimeoutMs, watchSentinel,
+                                                 &verboseOutput, &err);
+    } else {
+      pipeline = Pipeline::createWithFileSource(inputArgs, QStringList(), false, &verboseOutput, &err);
+    }
+    pipeline->setReadAhead(readAhead);
+    pipeline->setFrameCache(frameCache);
+    if (useIndex) {
+      pipeline->setSequenceIndex(QSharedPointer<SequenceIndex>(new SequenceIndex(&verboseOutput, &err)));
+    }
+    if (!traceFile.isEmpty()) {
+      pipeline->enableTrace();
+    }
+    if (threaded) {
+      pipeline->setThreaded();
+      pipeline->setFlowControl(maxFrames, maxMemory);
+    }
+    pipeline->setWorkers(workers);
+    pipeline->setFastAnalysis(fastLuminance);
 
-    *pipeline << new ComputeLuminance(&verboseOutput);
+    *pipeline << pipeline->parallel([](QTextStream *verboseOutput, QTextStream *) {
+      return new ComputeLuminance(verboseOutput);
+    });
     *pipeline << new OneToOneFrameMapping();
     if (wmaCount > 0)
-      *pipeline << new WMALuminance(&verboseOutput, wmaCount);
+      *pipeline << new WMALuminance(pipeline->stageVerboseOutput(), wmaCount);
     else
-      *pipeline << new ComputeAverageLuminance(&verboseOutput);
-    *pipeline << new AdjustLuminance(&verboseOutput, debugView);
+      *pipeline << new ComputeAverageLuminance(pipeline->stageVerboseOutput());
+    *pipeline << pipeline->parallel([this](QTextStream *verboseOutput, QTextStream *) {
+      return new AdjustLuminance(verboseOutput, debugView);
+    });
+    if (gain != 1.0) {
+      // fused with luminance adjustment to single pass by the pipeline
+      *pipeline << pipeline->parallel([this](QTextStream *verboseOutput, QTextStream *) {
+        return new AdjustGain(verboseOutput, gain);
+      });
+    }
     //*pipeline << new ComputeLuminance(&verboseOutput);
-    *pipeline << new WriteFrame(output, &verboseOutput, dryRun);
+    if (!previewOutput.isEmpty()) {
+      // preview branch shares deflickered frames with full resolution output
+      PipelineBranch *preview = pipeline->fork();
+      *preview << pipeline->parallel([](QTextStream *verboseOutput, QTextStream *) {
+        return new ResizeFrame(verboseOutput, -1, PREVIEW_HEIGHT, false);
+      });
+      *preview << new AsyncWriteFrame(QDir(previewOutput), pipeline->stageVerboseOutput(), pipeline->stageErr(), dryRun);
+    }
+    *pipeline << new AsyncWriteFrame(output, pipeline->stageVerboseOutput(), pipeline->stageErr(), dryRun,
+      true, frameFormat);
 
     connect(pipeline, &Pipeline::done, this, &TimeLapseDeflicker::cleanup);
     connect(pipeline, &Pipeline::error, this, &TimeLapseDeflicker::onError);
@@ -23,6 +23,7 @@
 #include <TimeLapse/black_hole_device.h>
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline.h>
+#include <TimeLapse/pipeline_write_frame.h>
 
 #include <Magick++.h>
 
@@ -39,6 +40,9 @@ using namespace timelapse;
 
 namespace timelapse {
 
+  /* height of frames written to preview directory */
+  constexpr int PREVIEW_HEIGHT = 720;
+
   class TIME_LAPSE_API TimeLapseDeflicker : public QCoreApplication {
     Q_OBJECT
 
@@ -63,13 +67,31 @@ namespace timelapse {
     QTextStream out;
     QTextStream err;
     bool dryRun;
+    FrameFormat frameFormat;
     bool debugView;
+    double gain;
+    bool threaded;
+    int workers;
+    int maxFrames;
+    int64_t maxMemory;
+    int readAhead;
+    QSharedPointer<DecodedFrameCache> frameCache;
+    bool fastLuminance;
+    bool useIndex;
+    bool watch;
+    int64_t watchTimeoutMs;
+    QString watchSentinel;
+    QString statsFile;
+    QString traceFile;
     size_t wmaCount;
     QTextStream verboseOutput;
     BlackHoleDevice *blackHole;
 
     Pipeline *pipeline;
     QDir output;
+
+    /* directory for downscaled preview frames, empty when preview is disabled */
+    QString previewOutput;
   };
 
 }
@@ -26,6 +26,7 @@
 #include <TimeLapse/pipeline_write_frame.h>
 #include <TimeLapse/pipeline_handler.h>
 #include <TimeLapse/pipeline_frame_mapping.h>
+#include <TimeLapse/pipeline_frame_cache.h>
 
 #include <QtCore/QObject>
 #include <QtCore/QTimer>
@@ -45,7 +46,8 @@ namespace timelapse {
   out(stdout), err(stderr),
   verboseOutput(stdout), blackHole(nullptr),
   pipeline(nullptr), stabConf(nullptr), output(),
-  dryRun(false),
+  dryRun(false), threaded(false), maxFrames(DEFAULT_MAX_IN_FLIGHT_FRAMES), maxMemory(0), readAhead(0),
+  cacheMemory(DEFAULT_FRAME_CACHE_MEMORY),
   tempDir(nullptr) {
 
     setApplicationName("TimeLapse stabilize tool");
@@ -86,6 +88,53 @@ namespace timelapse {
       QCoreApplication::translate("main", "Just parse arguments, check inputs and prints information."));
     parser.addOption(dryRunOption);
 
+    QCommandLineOption frameFormatOption(QStringList() << "frame-format",
+      QCoreApplication::translate("main", "Format of written frames: ppm, pam, png[:level] or jpeg[:quality[:subsampling]]. "
+      "Level is PNG compression level (0-9), quality is JPEG quality (1-100) "
+      "and subsampling is JPEG chroma subsampling (420, 422 or 444). Default is jpeg."),
+      QCoreApplication::translate("main", "format"));
+    parser.addOption(frameFormatOption);
+
+    QCommandLineOption threadedOption(QStringList() << "threaded",
+      QCoreApplication::translate("main", "Run every processing stage in its own thread."));
+    parser.addOption(threadedOption);
+
+    QCommandLineOption maxFramesOption(QStringList() << "max-frames",
+      QCoreApplication::translate("main", "Maximum number of decoded frames in flight (threaded mode only). Default is %1.")
+        .arg(DEFAULT_MAX_IN_FLIGHT_FRAMES),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(maxFramesOption);
+
+    QCommandLineOption maxMemoryOption(QStringList() << "max-memory",
+      QCoreApplication::translate("main", "Maximum memory used by decoded frames in flight, in MiB (threaded mode only). "
+      "Unlimited by default."),
+      QCoreApplication::translate("main", "MiB"));
+    parser.addOption(maxMemoryOption);
+
+    QCommandLineOption readAheadOption(QStringList() << "read-ahead",
+      QCoreApplication::translate("main", "Count of images decoded ahead on background threads "
+      "while current frame is processed. It is limited by frame budget in threaded mode. Disabled by default."),
+      QCoreApplication::translate("main", "count"));
+    parser.addOption(readAheadOption);
+
+    QCommandLineOption cacheMemoryOption(QStringList() << "cache-memory",
+      QCoreApplication::translate("main", "Memory used for decoded frames kept between detection and transformation pass, in MiB. "
+      "Frames over this limit are stored in uncompressed temporary file. Default is %1.")
+        .arg(DEFAULT_FRAME_CACHE_MEMORY / (1024 * 1024)),
+      QCoreApplication::translate("main", "MiB"));
+    parser.addOption(cacheMemoryOption);
+
+    QCommandLineOption statsOption(QStringList() << "stats",
+      QCoreApplication::translate("main", "Write per-stage performance report (JSON) to given file."),
+      QCoreApplication::translate("main", "file"));
+    parser.addOption(statsOption);
+
+    QCommandLineOption traceOption(QStringList() << "trace",
+      QCoreApplication::translate("main", "Record execution of pipeline stages to given file "
+      "(Chrome trace-event format, it may be opened by chrome://tracing or Perfetto)."),
+      QCoreApplication::translate("main", "file"));
+    parser.addOption(traceOption);
+
     QCommandLineOption verboseOption(QStringList() << "V" << "verbose",
       QCoreApplication::translate("main", "Verbose output."));
     parser.addOption(verboseOption);
@@ -111,6 +160,43 @@ namespace timelapse {
     }
 
     dryRun = parser.isSet(dryRunOption);
+    threaded = parser.isSet(threadedOption);
+    bool ok = false;
+    if (parser.isSet(frameFormatOption)) {
+      frameFormat = FrameFormat::parse(parser.value(frameFormatOption), &ok);
+      if (!ok) die << "Can't parse frame format";
+    }
+    if (parser.isSet(maxFramesOption)) {
+      maxFrames = parser.value(maxFramesOption).toInt(&ok);
+      if (!ok) die << "Can't parse max frames";
+      if (maxFrames < MIN_IN_FLIGHT_FRAMES) die << QString("Max frames have to be at least %1").arg(MIN_IN_FLIGHT_FRAMES);
+    }
+    if (parser.isSet(maxMemoryOption)) {
+      maxMemory = parser.value(maxMemoryOption).toLongLong(&ok) * 1024 * 1024;
+      if (!ok) die << "Can't parse max memory";
+      if (maxMemory <= 0) die << "Max memory have to be positive!";
+    }
+    if (!threaded && (parser.isSet(maxFramesOption) || parser.isSet(maxMemoryOption))) {
+      err << "Frame budget is used just in threaded mode, ignore \"max-frames\" and \"max-memory\" options." << endl;
+    }
+    if (parser.isSet(readAheadOption)) {
+      readAhead = parser.value(readAheadOption).toInt(&ok);
+      if (!ok) die << "Can't parse read-ahead count";
+      if (readAhead < 0) die << "Read-ahead count can't be negative!";
+    }
+    if (parser.isSet(cacheMemoryOption)) {
+      cacheMemory = parser.value(cacheMemoryOption).toLongLong(&ok) * 1024 * 1024;
+      if (!ok) die << "Can't parse cache memory";
+      if (cacheMemory < 0) die << "Cache memory can't be negative!";
+    }
+    if (parser.isSet(statsOption)) {
+      statsFile = parser.value(statsOption);
+      if (statsFile.isEmpty()) die << "Stats file is empty";
+    }
+    if (parser.isSet(traceOption)) {
+      traceFile = parser.value(traceOption);
+      if (traceFile.isEmpty()) die << "Trace file is empty";
+    }
 
     stabConf->processOptions(parser, die, &err);
 
@@ -152,6 +238,12 @@ namespace timelapse {
 
   void TimeLapseStabilize::cleanup2(int exitCode) {
     if (pipeline != nullptr) {
+      if (!statsFile.isEmpty()) {
+        pipeline->writeStats(statsFile);
+      }
+      if (!traceFile.isEmpty()) {
+        pipeline->writeTrace(traceFile);
+      }
       pipeline->deleteLater();
       pipeline = nullptr;
     }
@@ -168,20 +260,32 @@ namespace timelapse {
     QStringList inputArgs = parseArguments();
 
     // build processing pipeline
-    stabInit(&verboseOutput, &err);
+    pipeline = Pipeline::createWithFileSource(inputArgs, QStringList(), false, &verboseOutput, &err);
+    pipeline->setReadAhead(readAhead);
+    if (!traceFile.isEmpty()) {
+      pipeline->enableTrace();
+    }
+    if (threaded) {
+      pipeline->setThreaded();
+      pipeline->setFlowControl(maxFrames, maxMemory);
+    }
 
+    // vid.stab log is used by detection and transformation stages,
+    // but these stages never run concurrently (they are divided by FrameCacheSeparator)
+    stabInit(pipeline->stageVerboseOutput(), pipeline->stageErr());
 
-    pipeline = Pipeline::createWithFileSource(inputArgs, QStringList(), false, &verboseOutput, &err);
     *pipeline << new OneToOneFrameMapping();
-    *pipeline << new PipelineStabDetect(stabConf, &verboseOutput, &err);
+    *pipeline << new PipelineStabDetect(stabConf, pipeline->stageVerboseOutput(), pipeline->stageErr());
     if (stabConf->mdConf.show > 0) {
-      *pipeline << new WriteFrame(QDir(tempDir->path()), &verboseOutput, dryRun);
+      *pipeline << new WriteFrame(QDir(tempDir->path()), pipeline->stageVerboseOutput(), dryRun);
     }
     
-    *pipeline << new StageSeparator();
+    // keep decoded frames for the second pass, it avoids decoding images again
+    *pipeline << new FrameCacheSeparator(pipeline->stageVerboseOutput(), pipeline->stageErr(), cacheMemory);
 
-    *pipeline << new PipelineStabTransform(stabConf, &verboseOutput, &err);
-    *pipeline << new WriteFrame(output, &verboseOutput, dryRun);
+    *pipeline << new PipelineStabTransform(stabConf, pipeline->stageVerboseOutput(), pipeline->stageErr());
+    *pipeline << new AsyncWriteFrame(output, pipeline->stageVerboseOutput(), pipeline->stageErr(), dryRun,
+      true, frameFormat);
 
     connect(pipeline, &Pipeline::done, this, &TimeLapseStabilize::cleanup);
     connect(pipeline, &Pipeline::error, this, &TimeLapseStabilize::onError);
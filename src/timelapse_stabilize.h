@@ -22,6 +22,7 @@
 #include <TimeLapse/black_hole_device.h>
 #include <TimeLapse/input_image_info.h>
 #include <TimeLapse/pipeline.h>
+#include <TimeLapse/pipeline_write_frame.h>
 #include <TimeLapse/pipeline_stab.h>
 
 #include <TimeLapse/libvidstab.h>
@@ -88,6 +89,14 @@ namespace timelapse {
     QDir output;
 
     bool dryRun;
+    FrameFormat frameFormat;
+    bool threaded;
+    int maxFrames;
+    int64_t maxMemory;
+    int readAhead;
+    int64_t cacheMemory;
+    QString statsFile;
+    QString traceFile;
     QTemporaryDir *tempDir;
   };
 }
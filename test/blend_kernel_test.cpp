@@ -0,0 +1,99 @@
+/*
+ *   Copyright (C) 2026 Lukáš Karas <lukas.karas@centrum.cz>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+/*
+ * Compares every crossfade implementation supported by this CPU with the scalar formula,
+ * including tails that are not multiple of vector width and boundary weights.
+ */
+
+#include <TimeLapse/blend_kernel.h>
+
+#include <cstdio>
+#include <vector>
+
+using namespace timelapse;
+
+namespace {
+
+  uint8_t expected(uint8_t a, uint8_t b, uint32_t weightA) {
+    if (weightA > 256) {
+      weightA = 256;
+    }
+    return (uint8_t) ((a * weightA + b * (256 - weightA) + 128) >> 8);
+  }
+
+  bool check(const char *name, size_t count, uint32_t weightA) {
+    std::vector<uint8_t> a(count);
+    std::vector<uint8_t> b(count);
+    std::vector<uint8_t> out(count + 1, 0xAB);
+    uint32_t seed = (uint32_t) (count * 31 + weightA);
+    for (size_t i = 0; i < count; i++) {
+      // extreme values at the start, pseudo-random data after
+      seed = seed * 1103515245 + 12345;
+      a[i] = i == 0 ? 255 : (uint8_t) (seed >> 16);
+      b[i] = i == 0 ? 0 : (uint8_t) (seed >> 24);
+    }
+
+    bool ok = name == nullptr ?
+              (crossfade(a.data(), b.data(), out.data(), count, weightA), true) :
+              crossfade(name, a.data(), b.data(), out.data(), count, weightA);
+    if (!ok) {
+      std::fprintf(stderr, "%s: implementation is not supported\n", name);
+      return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (out[i] != expected(a[i], b[i], weightA)) {
+        std::fprintf(stderr, "%s: count %zu, weight %u: out[%zu] = %u, expected %u\n",
+                     name == nullptr ? "default" : name, count, weightA, i,
+                     out[i], expected(a[i], b[i], weightA));
+        return false;
+      }
+    }
+    if (out[count] != 0xAB) {
+      std::fprintf(stderr, "%s: count %zu, weight %u: written behind the buffer\n",
+                   name == nullptr ? "default" : name, count, weightA);
+      return false;
+    }
+    return true;
+  }
+}
+
+int main() {
+  const size_t counts[] = {0, 1, 7, 15, 16, 17, 31, 32, 33, 63, 64, 100, 1000, 1023};
+  const uint32_t weights[] = {0, 1, 64, 127, 128, 129, 255, 256, 300};
+
+  std::vector<const char*> names = crossfadeImplementations();
+  names.push_back(nullptr); // default crossfade
+  int failures = 0;
+  for (const char *name: names) {
+    std::printf("checking %s\n", name == nullptr ? crossfadeImplementation() : name);
+    for (size_t count: counts) {
+      for (uint32_t weight: weights) {
+        if (!check(name, count, weight)) {
+          failures++;
+        }
+      }
+    }
+  }
+  if (crossfade("unknown", nullptr, nullptr, nullptr, 0, 0)) {
+    std::fprintf(stderr, "unknown implementation should not be supported\n");
+    failures++;
+  }
+  return failures == 0 ? 0 : 1;
+}
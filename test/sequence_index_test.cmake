@@ -0,0 +1,53 @@
+# Runs deflicker with --index several times on a copy of the test data:
+#  - first run builds the index sidecar,
+#  - second run reuses it (luminance from index, images not decoded),
+#  - file with changed modification time is measured again.
+#
+# Required variables: DEFLICKER (executable), DATA_DIR (input images), WORK_DIR
+
+set(INPUT_DIR "${WORK_DIR}/input")
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(COPY "${DATA_DIR}/" DESTINATION "${INPUT_DIR}")
+
+function(run_deflicker OUTPUT_NAME RESULT_VAR)
+    execute_process(
+        COMMAND "${DEFLICKER}" --verbose --index --output "${WORK_DIR}/${OUTPUT_NAME}" "${INPUT_DIR}"
+        RESULT_VARIABLE result
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE output)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "Deflicker failed (${result}):\n${output}")
+    endif()
+    set(${RESULT_VAR} "${output}" PARENT_SCOPE)
+endfunction()
+
+run_deflicker(first output)
+if (NOT EXISTS "${INPUT_DIR}/.timelapse.index")
+    message(FATAL_ERROR "Index was not created:\n${output}")
+endif()
+if (output MATCHES "luminance from index")
+    message(FATAL_ERROR "First run used index that should not exist:\n${output}")
+endif()
+
+run_deflicker(second output)
+if (output MATCHES "/1\\.jpg luminance: ")
+    message(FATAL_ERROR "Second run computed luminance of indexed image:\n${output}")
+endif()
+if (NOT output MATCHES "/1\\.jpg luminance from index")
+    message(FATAL_ERROR "Second run did not use the index:\n${output}")
+endif()
+if (NOT output MATCHES "skipped, pixels are not needed")
+    message(FATAL_ERROR "Second run decoded indexed images for analysis:\n${output}")
+endif()
+
+# changed file invalidates its entry
+execute_process(COMMAND "${CMAKE_COMMAND}" -E sleep 1)
+execute_process(COMMAND "${CMAKE_COMMAND}" -E touch "${INPUT_DIR}/1.jpg")
+run_deflicker(third output)
+if (NOT output MATCHES "/1\\.jpg luminance: ")
+    message(FATAL_ERROR "Luminance of modified image was not computed again:\n${output}")
+endif()
+if (NOT output MATCHES "/2\\.jpg luminance from index")
+    message(FATAL_ERROR "Index entries of unmodified images were not used:\n${output}")
+endif()
@@ -0,0 +1,48 @@
+# Runs deflicker watching empty directory while images are dropped into it together
+# with sidecar, temporary and broken files. Non-image files have to be ignored,
+# broken image skipped and all valid images processed.
+#
+# Required variables: DEFLICKER (executable), DATA_DIR (input images), WORK_DIR
+# Internal: DROP_TO is set when the script runs as the writer of the images.
+
+if (DEFINED DROP_TO)
+    # give deflicker time to start watching
+    execute_process(COMMAND "${CMAKE_COMMAND}" -E sleep 2)
+    file(WRITE "${DROP_TO}/1.xmp" "<x:xmpmeta/>")
+    file(WRITE "${DROP_TO}/broken.jpg" "not an image")
+    file(GLOB images "${DATA_DIR}/*.jpg")
+    foreach(image ${images})
+        get_filename_component(name "${image}" NAME)
+        # partially transferred file, like rsync or camera upload
+        file(WRITE "${DROP_TO}/${name}.tmp" "partial")
+        execute_process(COMMAND "${CMAKE_COMMAND}" -E copy "${image}" "${DROP_TO}/${name}")
+    endforeach()
+    file(WRITE "${DROP_TO}/DONE" "")
+    return()
+endif()
+
+set(INPUT_DIR "${WORK_DIR}/input")
+set(OUTPUT_DIR "${WORK_DIR}/output")
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${INPUT_DIR}")
+
+# commands of execute_process run concurrently as a pipeline: stdout of the writer
+# (which prints nothing) is piped to stdin of deflicker (which doesn't read it),
+# stdout of deflicker is the output of whole pipeline, so it may be verbose
+execute_process(
+    COMMAND "${CMAKE_COMMAND}" -DDROP_TO=${INPUT_DIR} -DDATA_DIR=${DATA_DIR} -P "${CMAKE_CURRENT_LIST_FILE}"
+    COMMAND "${DEFLICKER}" --verbose --watch --watch-sentinel DONE --watch-timeout 60 --output "${OUTPUT_DIR}" "${INPUT_DIR}"
+    RESULTS_VARIABLE results
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE output)
+if (NOT results STREQUAL "0;0")
+    message(FATAL_ERROR "Watching deflicker failed (${results}):\n${output}")
+endif()
+
+file(GLOB images "${DATA_DIR}/*.jpg")
+file(GLOB frames "${OUTPUT_DIR}/*")
+list(LENGTH images expected)
+list(LENGTH frames written)
+if (NOT written EQUAL expected)
+    message(FATAL_ERROR "Expected ${expected} frames, ${written} written:\n${output}")
+endif()